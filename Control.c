@@ -0,0 +1,807 @@
+/*****************************************************************
+* Module name: Control
+*
+* Copyright 1997 Company as an unpublished work.
+* All Rights Reserved.
+*
+* The information contained herein is confidential
+* property of Company. The user, copying, transfer or
+* disclosure of such information is prohibited except
+* by express written agreement with Company.
+*
+* First written on 19/10/26 by Connor Parker.
+*
+* Module Description:
+* -------------------
+* Timer driven inner control loop, see Control.h.
+*
+*****************************************************************
+*  Includes section
+*****************************************************************/
+
+/* Standard Altera include files to enable the mapping of names
+To hardware addresses etc. */
+#include "system.h"
+#include "altera_avalon_pio_regs.h"
+#include "altera_avalon_timer_regs.h"
+#include "alt_types.h"
+#include "sys/alt_irq.h"
+
+#include "Control.h"
+#include "Recorder.h"
+
+/*****************************************************************
+*  Defines section
+*****************************************************************/
+
+/* Flags for reading ADC, same handshake as the old read_adc() */
+#define START_FLAG 0x8000
+#define DONE_FLAG  0x8000
+
+/* Ticks to wait for a conversion before giving up on it */
+#define ADC_MAX_WAIT_TICKS 4
+
+/* Duty scale is fixed point, this much is x1 */
+#define DUTY_SCALE_ONE 256
+
+/* Motor nibble bits, per wheel an enable and a forward bit */
+#define LEFT_ENABLE   0x1
+#define RIGHT_ENABLE  0x2
+#define LEFT_FORWARD  0x4
+#define RIGHT_FORWARD 0x8
+
+/* Motor command and the two wheel duties share one word so the
+ * ISR never sees a new command with the old duty */
+#define COMMAND(motors, left, right) \
+    (((alt_u32)(right) << 16) | ((alt_u32)(left) << 8) | ((motors) & 0xF))
+#define COMMAND_MOTORS(command) ((command) & 0xF)
+#define COMMAND_LEFT(command)   (((command) >> 8) & 0xFF)
+#define COMMAND_RIGHT(command)  (((command) >> 16) & 0xFF)
+
+/* Last way a wheel was powered, for counting reversals */
+#define WHEEL_NONE    0
+#define WHEEL_FORWARD 1
+#define WHEEL_REVERSE 2
+
+/* Energy of one wheel for one tick in uJ, mV x mA gives uW */
+#define WHEEL_TICK_UJ(mv) \
+    (((alt_u32)(mv) * CONTROL_MOTOR_MA) / CONTROL_RATE_HZ)
+
+/*****************************************************************
+*  Variables section
+*****************************************************************/
+
+/* written by the behaviour code, read by the ISR */
+static volatile alt_u32 command;
+static volatile alt_u32 stepper;
+
+/* written by the ISR, read by the behaviour code */
+static volatile alt_u32 inputs;
+static volatile alt_u16 adcValue;
+static volatile alt_u32 ticks;
+static volatile alt_u32 safetyStops;
+static volatile alt_u16 batteryMv;
+static volatile alt_u32 dutyScale;
+
+/* written by the ISR, copied out by controlStats() */
+static ControlStats stats;
+
+/* only used inside the ISR */
+static alt_u32 lastRaw;
+static alt_u32 written;
+static alt_u32 leftAccumulator;
+static alt_u32 rightAccumulator;
+static alt_u32 safetyBits;
+static alt_u8  stopped;
+static alt_u8  channel;
+static alt_u8  adcBusy;
+static alt_u8  adcWait;
+static alt_u8  adcPrimed;
+static alt_u8  converting;
+static alt_u8  batteryWait;
+static alt_u8  leftLast;
+static alt_u8  rightLast;
+static alt_u32 wheelUj;
+static alt_u32 energyUj;
+
+/*****************************************************************
+*  Function Prototype Section
+*****************************************************************/
+
+static void controlIsr(void *context);
+
+static void setCommand(alt_u32 motors, alt_u8 left, alt_u8 right);
+
+static alt_u8 drivesForward(alt_u32 motors);
+
+static alt_u8 dutyTick(alt_u32 *accumulator, alt_u32 duty);
+
+static void serviceAdc(void);
+
+static void batteryReading(alt_u16 data);
+
+static void account(alt_u32 commanded, alt_u32 motors, alt_u8 dutyOff);
+
+static void accountWheel(ControlWheelStats *wheel, alt_u8 *last,
+                         alt_u32 enabled, alt_u32 forward);
+
+/****************************************************************/
+
+/****************************************************************
+* Function name     : controlStart
+*    returns        : void
+*    arg1           : safetyMask - active low header bits that
+*                     stop forward motion while pressed, e.g.
+*                     LEFT_FRONT_BUMPER | RIGHT_FRONT_BUMPER
+*    arg2           : adcChannel - ADC channel to sample every
+*                     tick or CONTROL_NO_ADC
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Motors off, takes a first header reading
+*                     then starts the timer so the inner loop
+*                     runs from here on
+* Notes             : Call once at start up after the header
+*                     direction has been set
+****************************************************************/
+void controlStart(alt_u32 safetyMask, alt_u8 adcChannel)
+{
+    alt_u32 period;
+
+    recorderInit();
+
+    command = COMMAND(CONTROL_MOTORS_OFF, 0, 0);
+    stepper = 0;
+
+    lastRaw = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+    inputs  = lastRaw;
+
+    adcValue    = 0;
+    ticks       = 0;
+    safetyStops = 0;
+    batteryMv   = 0;
+    dutyScale   = DUTY_SCALE_ONE;
+
+    leftAccumulator  = 0;
+    rightAccumulator = 0;
+    safetyBits = safetyMask;
+    stopped    = 0;
+    channel    = adcChannel;
+    adcBusy    = 0;
+    adcWait    = 0;
+    adcPrimed  = 0;
+    converting = CONTROL_NO_ADC;
+
+    stats.left.forwardTicks  = 0;
+    stats.left.reverseTicks  = 0;
+    stats.left.reversals     = 0;
+    stats.right.forwardTicks = 0;
+    stats.right.reverseTicks = 0;
+    stats.right.reversals    = 0;
+    stats.ticks        = 0;
+    stats.stopTicks    = 0;
+    stats.safetyTicks  = 0;
+    stats.dutyOffTicks = 0;
+    stats.energyMj     = 0;
+
+    leftLast  = WHEEL_NONE;
+    rightLast = WHEEL_NONE;
+    wheelUj   = WHEEL_TICK_UJ(CONTROL_BATTERY_NOMINAL_MV);
+    energyUj  = 0;
+
+    /* first reading on the first tick */
+    batteryWait = CONTROL_BATTERY_EVERY - 1;
+
+    written = CONTROL_MOTORS_OFF;
+
+    IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE, written);
+
+    period = (CONTROL_TIMER_FREQ / CONTROL_RATE_HZ) - 1;
+
+    IOWR_ALTERA_AVALON_TIMER_CONTROL(CONTROL_TIMER_BASE, ALTERA_AVALON_TIMER_CONTROL_STOP_MSK);
+    IOWR_ALTERA_AVALON_TIMER_PERIODL(CONTROL_TIMER_BASE, period & 0xFFFF);
+    IOWR_ALTERA_AVALON_TIMER_PERIODH(CONTROL_TIMER_BASE, period >> 16);
+    IOWR_ALTERA_AVALON_TIMER_STATUS(CONTROL_TIMER_BASE, 0);
+
+    alt_ic_isr_register(CONTROL_TIMER_IRQ_INTERRUPT_CONTROLLER_ID,
+                        CONTROL_TIMER_IRQ, controlIsr, 0x0, 0x0);
+
+    IOWR_ALTERA_AVALON_TIMER_CONTROL(CONTROL_TIMER_BASE,
+                                     ALTERA_AVALON_TIMER_CONTROL_ITO_MSK |
+                                     ALTERA_AVALON_TIMER_CONTROL_CONT_MSK |
+                                     ALTERA_AVALON_TIMER_CONTROL_START_MSK);
+}
+
+/****************************************************************
+* Function name     : controlSetMotors
+*    returns        : void
+*    arg1           : motors - motor nibble, same values the
+*                     modules used to write to the header
+*    arg2           : duty - ticks on out of CONTROL_DUTY_FULL
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Sets what the motors do from the next tick
+*                     until told otherwise
+* Notes             : n/a
+****************************************************************/
+void controlSetMotors(alt_u32 motors, alt_u8 duty)
+{
+    setCommand(motors, duty, duty);
+}
+
+/****************************************************************
+* Function name     : controlSteer
+*    returns        : void
+*    arg1           : curve - how hard to turn, + is left, from
+*                     -CONTROL_CURVE_FULL to CONTROL_CURVE_FULL
+*    arg2           : duty - duty of the outside wheel
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Drives forward on a curve. The inside wheel
+*                     runs at (1 - curve / CONTROL_CURVE_FULL) of
+*                     the outside one, so 0 is straight ahead and
+*                     full curve turns on the inside wheel.
+* Notes             : Heading changes at curve / (2 x
+*                     CONTROL_CURVE_FULL) of the rate of a pivot at
+*                     the same duty. Turn tighter than full curve
+*                     with a pivot.
+****************************************************************/
+void controlSteer(int curve, alt_u8 duty)
+{
+    alt_u32 inner;
+
+    if (duty > CONTROL_DUTY_FULL)
+    {
+        duty = CONTROL_DUTY_FULL;
+    }
+
+    if (curve > CONTROL_CURVE_FULL)
+    {
+        curve = CONTROL_CURVE_FULL;
+    }
+    else if (curve < -CONTROL_CURVE_FULL)
+    {
+        curve = -CONTROL_CURVE_FULL;
+    }
+
+    if (curve >= 0)
+    {
+        inner = ((alt_u32)duty * (CONTROL_CURVE_FULL - curve)) / CONTROL_CURVE_FULL;
+
+        setCommand(LEFT_ENABLE | RIGHT_ENABLE | LEFT_FORWARD | RIGHT_FORWARD, (alt_u8)inner, duty);
+    }
+    else
+    {
+        inner = ((alt_u32)duty * (CONTROL_CURVE_FULL + curve)) / CONTROL_CURVE_FULL;
+
+        setCommand(LEFT_ENABLE | RIGHT_ENABLE | LEFT_FORWARD | RIGHT_FORWARD, duty, (alt_u8)inner);
+    }
+}
+
+/****************************************************************
+* Function name     : setCommand
+*    returns        : void
+*    arg1           : motors - motor nibble
+*    arg2           : left - left wheel duty
+*    arg3           : right - right wheel duty
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Hands a new command to the inner loop in one
+*                     write
+* Notes             : n/a
+****************************************************************/
+static void setCommand(alt_u32 motors, alt_u8 left, alt_u8 right)
+{
+    if (left > CONTROL_DUTY_FULL)
+    {
+        left = CONTROL_DUTY_FULL;
+    }
+
+    if (right > CONTROL_DUTY_FULL)
+    {
+        right = CONTROL_DUTY_FULL;
+    }
+
+    recorderMotors(motors, left, right);
+
+    command = COMMAND(motors, left, right);
+}
+
+/****************************************************************
+* Function name     : controlSetStepper
+*    returns        : void
+*    arg1           : nibble - coil pattern for header bits 28-31
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Sets the light sensor stepper coils from the
+*                     next tick
+* Notes             : Wait at least a tick between steps or one
+*                     may never reach the header
+****************************************************************/
+void controlSetStepper(alt_u32 nibble)
+{
+    recorderStepper(nibble & 0xF);
+
+    stepper = nibble & 0xF;
+}
+
+/****************************************************************
+* Function name     : controlInputs
+*    returns        : debounced header, same bits and sense as
+*                     reading the PIO directly
+*    arg1           : void
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : A bit only changes here once two ticks in a
+*                     row have read it the same
+* Notes             : Recorded, see Recorder.h
+****************************************************************/
+alt_u32 controlInputs(void)
+{
+    return recorderInputs(inputs);
+}
+
+/****************************************************************
+* Function name     : controlAdc
+*    returns        : smoothed 12 bit ADC value
+*    arg1           : void
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Average of the last few conversions, about
+*                     a millisecond's worth
+* Notes             : 0 until the first conversion finishes.
+*                     Recorded, see Recorder.h
+****************************************************************/
+alt_u16 controlAdc(void)
+{
+    return recorderAdc(adcValue);
+}
+
+/****************************************************************
+* Function name     : controlTicks
+*    returns        : inner loop ticks since controlStart()
+*    arg1           : void
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Time base for the behaviour code, one tick
+*                     is CONTROL_TICK_US
+* Notes             : n/a
+****************************************************************/
+alt_u32 controlTicks(void)
+{
+    return ticks;
+}
+
+/****************************************************************
+* Function name     : controlSafetyStops
+*    returns        : number of times the safety stop has cut the
+*                     motors
+*    arg1           : void
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Counts each time the inner loop starts
+*                     overriding a command, not every tick it does
+* Notes             : n/a
+****************************************************************/
+alt_u32 controlSafetyStops(void)
+{
+    return safetyStops;
+}
+
+/****************************************************************
+* Function name     : controlBatteryMv
+*    returns        : smoothed pack voltage in mV, 0 until the
+*                     first reading
+*    arg1           : void
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Averaged over a second or so, so motor load
+*                     coming and going does not move it much
+* Notes             : n/a
+****************************************************************/
+alt_u16 controlBatteryMv(void)
+{
+    return batteryMv;
+}
+
+/****************************************************************
+* Function name     : controlMotionUs
+*    returns        : how long to run the move for now
+*    arg1           : us - length of the move at the nominal
+*                     battery voltage
+*    arg2           : duty - duty the move is made at
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : The inner loop raises duty as the pack runs
+*                     down. Once that would go past full duty the
+*                     move is stretched by the shortfall so it
+*                     still covers the same distance or angle.
+* Notes             : Only for open loop moves, e.g.
+*                     usleep(controlMotionUs(TURN_US, duty)).
+*                     Unchanged while the pack is above nominal.
+****************************************************************/
+alt_u32 controlMotionUs(alt_u32 us, alt_u8 duty)
+{
+    alt_u32 wanted;
+
+    /* duty the inner loop would like to give this move */
+    wanted = ((alt_u32)duty * dutyScale) / DUTY_SCALE_ONE;
+
+    if (wanted <= CONTROL_DUTY_FULL)
+    {
+        return us;
+    }
+
+    return (us * wanted) / CONTROL_DUTY_FULL;
+}
+
+/****************************************************************
+* Function name     : controlStats
+*    returns        : void
+*    arg1           : copy - filled in with the counts so far
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Takes the counts with interrupts off so they
+*                     all come from the same tick
+* Notes             : The tick counts wrap after about 12 days
+****************************************************************/
+void controlStats(ControlStats *copy)
+{
+    alt_irq_context context;
+
+    context = alt_irq_disable_all();
+
+    *copy = stats;
+
+    alt_irq_enable_all(context);
+}
+
+/****************************************************************
+* Function name     : controlIsr
+*    returns        : void
+*    arg1           : context - unused
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : One inner loop tick. Sense, then check
+*                     safety, then drive. The header is read once
+*                     here and every controlInputs() until the
+*                     next tick shares that reading.
+* Notes             : Runs CONTROL_RATE_HZ times a second so it
+*                     must never wait on anything
+****************************************************************/
+static void controlIsr(void *context)
+{
+    alt_u32 raw, same, current, motors, output;
+    alt_u8 leftOn, rightOn, dutyOff;
+
+    (void)context;
+
+    /* acknowledge the timer */
+    IOWR_ALTERA_AVALON_TIMER_STATUS(CONTROL_TIMER_BASE, 0);
+
+    /* bits read the same two ticks running are taken as real */
+    raw  = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+    same = ~(raw ^ lastRaw);
+
+    inputs  = (inputs & ~same) | (raw & same);
+    lastRaw = raw;
+
+    serviceAdc();
+
+    current = command;
+    motors  = COMMAND_MOTORS(current);
+
+    /* each wheel on or off this tick by its own duty */
+    leftOn  = dutyTick(&leftAccumulator, COMMAND_LEFT(current));
+    rightOn = dutyTick(&rightAccumulator, COMMAND_RIGHT(current));
+
+    dutyOff = ((motors & LEFT_ENABLE) && !leftOn) || ((motors & RIGHT_ENABLE) && !rightOn);
+
+    if (!leftOn && !rightOn)
+    {
+        motors = CONTROL_MOTORS_OFF;
+    }
+    else if (!leftOn)
+    {
+        motors &= ~LEFT_ENABLE;
+    }
+    else if (!rightOn)
+    {
+        motors &= ~RIGHT_ENABLE;
+    }
+
+    /* never drive into something a safety bit says is there */
+    if (((inputs & safetyBits) != safetyBits) && drivesForward(COMMAND_MOTORS(current)))
+    {
+        if (!stopped)
+        {
+            safetyStops++;
+        }
+
+        stopped = 1;
+        motors  = CONTROL_MOTORS_OFF;
+    }
+    else
+    {
+        stopped = 0;
+    }
+
+    /* written is a shadow of the outputs, the bus is only used
+     * when they change */
+    output = (stepper << 28) | motors;
+
+    if (output != written)
+    {
+        IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE, output);
+
+        written = output;
+    }
+
+    account(COMMAND_MOTORS(current), motors, dutyOff);
+
+    ticks++;
+}
+
+/****************************************************************
+* Function name     : dutyTick
+*    returns        : TRUE (1) if the wheel is on this tick
+*    arg1           : accumulator - that wheel's running total
+*    arg2           : duty - commanded duty for the wheel
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Scales the duty for the battery then spreads
+*                     the on ticks evenly, duty out of every
+*                     CONTROL_DUTY_FULL ticks
+* Notes             : Two wheels at the same duty switch together
+****************************************************************/
+static alt_u8 dutyTick(alt_u32 *accumulator, alt_u32 duty)
+{
+    /* battery compensated duty */
+    duty = (duty * dutyScale) / DUTY_SCALE_ONE;
+
+    if (duty > CONTROL_DUTY_FULL)
+    {
+        duty = CONTROL_DUTY_FULL;
+    }
+
+    *accumulator += duty;
+
+    if (*accumulator >= CONTROL_DUTY_FULL)
+    {
+        *accumulator -= CONTROL_DUTY_FULL;
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/****************************************************************
+* Function name     : drivesForward
+*    returns        : TRUE (1) if every powered wheel goes forward
+*    arg1           : motors - motor nibble
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Forward, or a one wheel turn forward, moves
+*                     the front of the robot into whatever is in
+*                     front of it. Pivots and reversing do not.
+* Notes             : n/a
+****************************************************************/
+static alt_u8 drivesForward(alt_u32 motors)
+{
+    if (!(motors & (LEFT_ENABLE | RIGHT_ENABLE)))
+    {
+        return 0;
+    }
+
+    if ((motors & LEFT_ENABLE) && !(motors & LEFT_FORWARD))
+    {
+        return 0;
+    }
+
+    if ((motors & RIGHT_ENABLE) && !(motors & RIGHT_FORWARD))
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+/****************************************************************
+* Function name     : serviceAdc
+*    returns        : void
+*    arg1           : void
+* Created by        : Ian Johnson, split up by Connor Parker
+* Date created      : 25/3/17
+* Description       : read_adc() cut in two so neither half waits.
+*                     Collects the conversion started last tick
+*                     then starts the next one, so the channel is
+*                     sampled once a tick. Every
+*                     CONTROL_BATTERY_EVERY ticks the battery gets
+*                     the slot instead.
+* Notes             : A conversion still not done after
+*                     ADC_MAX_WAIT_TICKS is abandoned and the old
+*                     value kept, not replaced with 0
+****************************************************************/
+static void serviceAdc(void)
+{
+    alt_u16 data;
+
+    if (adcBusy)
+    {
+        data = IORD(ADC_SPI_READ_BASE, 0);     // has the ADC finished?
+
+        if (data & DONE_FLAG)
+        {
+            /* 12 bit ADC, 4 bits for control, so clear the top 4 */
+            data &= 0xFFF;
+
+            if (converting == channel)
+            {
+                /* keep a running average of about four conversions */
+                adcValue  = adcPrimed ? (alt_u16)((adcValue * 3 + data) / 4) : data;
+                adcPrimed = 1;
+            }
+            else
+            {
+                batteryReading(data);
+            }
+        }
+        else if (++adcWait < ADC_MAX_WAIT_TICKS)
+        {
+            return;
+        }
+
+        IOWR(ADC_SPI_READ_BASE, 0, 0);          // tell ADC to stop
+        adcBusy = 0;
+    }
+
+    if ((CONTROL_BATTERY_CHANNEL != CONTROL_NO_ADC) && (++batteryWait >= CONTROL_BATTERY_EVERY))
+    {
+        batteryWait = 0;
+        converting  = CONTROL_BATTERY_CHANNEL;
+    }
+    else if (channel != CONTROL_NO_ADC)
+    {
+        converting = channel;
+    }
+    else
+    {
+        return;
+    }
+
+    IOWR(ADC_SPI_READ_BASE, 0, converting);     // specify channel
+    IOWR(ADC_SPI_READ_BASE, 0, converting | START_FLAG);    // tell ADC to start
+
+    adcBusy = 1;
+    adcWait = 0;
+}
+
+/****************************************************************
+* Function name     : batteryReading
+*    returns        : void
+*    arg1           : data - 12 bit conversion of the battery
+*                     channel
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Averages the pack voltage and works out the
+*                     duty scale that gives nominal speed from it
+* Notes             : Speed goes with voltage, so the scale is
+*                     nominal over measured
+****************************************************************/
+static void batteryReading(alt_u16 data)
+{
+    alt_u32 mv;
+
+    mv = ((alt_u32)data * CONTROL_BATTERY_FULL_SCALE_MV) / 4095;
+
+    /* long average, about 16 readings */
+    if (batteryMv)
+    {
+        mv = ((alt_u32)batteryMv * 15 + mv) / 16;
+    }
+
+    batteryMv = (alt_u16)mv;
+
+    if (mv < CONTROL_BATTERY_MIN_MV)
+    {
+        dutyScale = DUTY_SCALE_ONE;
+    }
+    else
+    {
+        dutyScale = (CONTROL_BATTERY_NOMINAL_MV * DUTY_SCALE_ONE) / mv;
+    }
+
+    /* no battery reading, estimate with the nominal voltage */
+    wheelUj = WHEEL_TICK_UJ((mv < CONTROL_BATTERY_MIN_MV) ? CONTROL_BATTERY_NOMINAL_MV : mv);
+}
+
+/****************************************************************
+* Function name     : account
+*    returns        : void
+*    arg1           : commanded - motor nibble the behaviour code
+*                     asked for
+*    arg2           : motors - motor nibble driven this tick
+*    arg3           : dutyOff - TRUE (1) if the duty had this tick
+*                     off
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Adds one tick to the stats. Where both wheels
+*                     were off it says why, then counts each wheel
+*                     and the energy of the ones that were on.
+* Notes             : Only additions and compares, it is on every
+*                     tick
+****************************************************************/
+static void account(alt_u32 commanded, alt_u32 motors, alt_u8 dutyOff)
+{
+    stats.ticks++;
+
+    if (!(commanded & (LEFT_ENABLE | RIGHT_ENABLE)))
+    {
+        stats.stopTicks++;
+    }
+    else if (stopped)
+    {
+        stats.safetyTicks++;
+    }
+    else if (dutyOff)
+    {
+        stats.dutyOffTicks++;
+    }
+
+    accountWheel(&stats.left, &leftLast, motors & LEFT_ENABLE, motors & LEFT_FORWARD);
+    accountWheel(&stats.right, &rightLast, motors & RIGHT_ENABLE, motors & RIGHT_FORWARD);
+
+    /* carry whole mJ, at most two a tick */
+    while (energyUj >= 1000)
+    {
+        energyUj -= 1000;
+        stats.energyMj++;
+    }
+}
+
+/****************************************************************
+* Function name     : accountWheel
+*    returns        : void
+*    arg1           : wheel - that wheel's counts
+*    arg2           : last - way the wheel was last powered
+*    arg3           : enabled - non zero if it is powered this tick
+*    arg4           : forward - non zero if that is forward
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Counts the tick against the way the wheel
+*                     went, and a reversal if that is not the way
+*                     it last went. Off ticks in between do not
+*                     end a run, so the duty gaps of a pivot are
+*                     not counted as reversals.
+* Notes             : n/a
+****************************************************************/
+static void accountWheel(ControlWheelStats *wheel, alt_u8 *last,
+                         alt_u32 enabled, alt_u32 forward)
+{
+    alt_u8 now;
+
+    if (!enabled)
+    {
+        return;
+    }
+
+    if (forward)
+    {
+        wheel->forwardTicks++;
+        now = WHEEL_FORWARD;
+    }
+    else
+    {
+        wheel->reverseTicks++;
+        now = WHEEL_REVERSE;
+    }
+
+    if ((*last != WHEEL_NONE) && (*last != now))
+    {
+        wheel->reversals++;
+    }
+
+    *last = now;
+
+    energyUj += wheelUj;
+}
@@ -0,0 +1,168 @@
+/*****************************************************************
+* Module name: Control
+*
+* Copyright 1997 Company as an unpublished work.
+* All Rights Reserved.
+*
+* The information contained herein is confidential
+* property of Company. The user, copying, transfer or
+* disclosure of such information is prohibited except
+* by express written agreement with Company.
+*
+* First written on 19/10/26 by Connor Parker.
+*
+* Module Description:
+* -------------------
+* Fast inner control loop run from a timer interrupt, so sensing
+* and safety carry on however long the behaviour code takes.
+*
+*    Every tick (CONTROL_RATE_HZ) the header is read once and
+*    debounced, an ADC conversion is collected and the next one
+*    started, and the motor outputs are updated. Outputs are
+*    kept in a shadow and only written when they change, so a
+*    steady command costs no bus writes
+*
+*    Motors are driven at a duty set by the behaviour code, the
+*    inner loop spreads the on ticks evenly so any duty from 0
+*    to CONTROL_DUTY_FULL works without a fixed PWM period.
+*    Each wheel has its own duty, controlSteer() uses that to
+*    drive forward on a curve rather than stopping to pivot
+*
+*    If a safety bit (normally the front bumpers) is pressed
+*    the motors are stopped on that tick while the command
+*    would drive into it. Reversing and pivoting still work so
+*    the behaviour code can back away
+*
+*    Every CONTROL_BATTERY_EVERY ticks the ADC slot goes to the
+*    battery instead. Motor duty is scaled by how far the pack
+*    is from CONTROL_BATTERY_NOMINAL_MV so the robot moves at
+*    the same speed as the pack runs down. When even full duty
+*    is not enough, controlMotionUs() stretches a timed move to
+*    make up the rest.
+*
+*    Every tick is also counted in a ControlStats: how long
+*    each wheel was driven each way, how often it changed
+*    direction, why it was off when it was off, and an energy
+*    estimate from the battery voltage and CONTROL_MOTOR_MA.
+*    controlStats() takes a copy for a run summary.
+*
+* Once controlStart() has been called the inner loop owns the
+* expansion header outputs and the ADC. Behaviour code must set
+* the motors and stepper through controlSetMotors() and
+* controlSetStepper(), and read sensors through controlInputs()
+* and controlAdc(), rather than touching the registers.
+*
+* The system needs an interval timer core named CONTROL_TIMER
+* with a writeable period and its IRQ connected. Battery
+* compensation needs the pack on CONTROL_BATTERY_CHANNEL through
+* a divider, build with CONTROL_BATTERY_CHANNEL defined as
+* CONTROL_NO_ADC on a robot without one.
+*
+*****************************************************************/
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "alt_types.h"
+
+/*****************************************************************
+*  Defines section
+*****************************************************************/
+
+/* Inner loop rate */
+#define CONTROL_RATE_HZ   4000
+#define CONTROL_TICK_US   (1000000 / CONTROL_RATE_HZ)
+
+/* Motor duty, on ticks out of CONTROL_DUTY_FULL */
+#define CONTROL_DUTY_FULL 100
+
+/* Duty matching a pulse of on microseconds followed by off */
+#define CONTROL_DUTY_OF(on, off) \
+    ((alt_u8)(((on) * CONTROL_DUTY_FULL) / ((on) + (off))))
+
+/* Motor nibble used for the off ticks, both wheels disabled */
+#define CONTROL_MOTORS_OFF 0xC
+
+/* controlSteer() curvature, + is left. At CONTROL_CURVE_FULL the
+ * inner wheel is stopped and the robot turns on it, half as fast
+ * as a pivot at the same duty */
+#define CONTROL_CURVE_FULL 100
+
+/* adcChannel for modules without an analogue sensor */
+#define CONTROL_NO_ADC    0xFF
+
+/* Battery measurement, the divider puts the pack at
+ * CONTROL_BATTERY_FULL_SCALE_MV when the ADC reads 4095 */
+#ifndef CONTROL_BATTERY_CHANNEL
+#define CONTROL_BATTERY_CHANNEL      2
+#endif
+#define CONTROL_BATTERY_FULL_SCALE_MV 10000
+#define CONTROL_BATTERY_EVERY        64     /* ticks between readings */
+
+/* Pack voltage every duration and duty was tuned at */
+#define CONTROL_BATTERY_NOMINAL_MV   7200
+
+/* Below this the reading is taken as no battery connected and
+ * nothing is compensated */
+#define CONTROL_BATTERY_MIN_MV       5000
+
+/* Running current of one drive motor, for the energy estimate.
+ * Measured on the bench with the robot driving on the floor */
+#ifndef CONTROL_MOTOR_MA
+#define CONTROL_MOTOR_MA             250
+#endif
+
+/*****************************************************************
+*  Types section
+*****************************************************************/
+
+/* Ticks one wheel spent powered each way. It was off for the
+ * rest of ControlStats.ticks */
+typedef struct
+{
+    alt_u32 forwardTicks;
+    alt_u32 reverseTicks;
+    alt_u32 reversals;      /* powered the other way to last time */
+} ControlWheelStats;
+
+/* Everything counted since controlStart(). A tick with a wheel
+ * off is put down to one reason, stop first, then safety, then
+ * duty */
+typedef struct
+{
+    ControlWheelStats left;
+    ControlWheelStats right;
+    alt_u32 ticks;
+    alt_u32 stopTicks;      /* command had both wheels off */
+    alt_u32 safetyTicks;    /* safety stop held the command off */
+    alt_u32 dutyOffTicks;   /* an off tick of the command's duty */
+    alt_u32 energyMj;       /* estimated energy into the motors */
+} ControlStats;
+
+/*****************************************************************
+*  Function Prototype Section
+*****************************************************************/
+
+void controlStart(alt_u32 safetyMask, alt_u8 adcChannel);
+
+void controlSetMotors(alt_u32 motors, alt_u8 duty);
+
+void controlSteer(int curve, alt_u8 duty);
+
+void controlSetStepper(alt_u32 nibble);
+
+alt_u32 controlInputs(void);
+
+alt_u16 controlAdc(void);
+
+alt_u32 controlTicks(void);
+
+alt_u32 controlSafetyStops(void);
+
+alt_u16 controlBatteryMv(void);
+
+alt_u32 controlMotionUs(alt_u32 us, alt_u8 duty);
+
+void controlStats(ControlStats *copy);
+
+#endif
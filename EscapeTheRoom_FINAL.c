@@ -17,7 +17,8 @@
  *                        is activated, it turns right. It uses an even element 
  *                        of randomness and strategy to escape a room. PWM is 
  *                        also implemented to determine the speed of the robot
- *                        going forward.
+ *                        going forward. The header, PWM and bumper safety
+ *                        stop are run by the Control inner loop.
  *******************************************************************************/
 
 /* Standard Altera include files to enable the mapping of names
@@ -29,6 +30,14 @@
 #include <stdlib.h>
 #include <time.h>
 
+#include "Control.h"
+#include "Recorder.h"
+
+/* Tuned timings generated by host/autotune */
+#ifdef USE_TUNED_PARAMS
+#include "TunedParams.h"
+#endif
+
 // Bumpers
 #define FRONT_BUMPERS 0x8800
 #define FRONT_LEFT_BUMPER 0x8000
@@ -38,6 +47,14 @@
 #define BACKWARD 0x3
 #define ROTATE_RIGHT 0x7
 #define ROTATE_LEFT 0xB
+// Tuning - defaults found by hand, USE_TUNED_PARAMS takes them from TunedParams.h
+#ifndef ESCAPE_FORWARD_DUTY
+#define ESCAPE_FORWARD_DUTY 6000    // forward() speed, 0 - 10000
+#endif
+#ifndef ESCAPE_ROTATE_US
+#define ESCAPE_ROTATE_US 50000      // time spent rotating per rotate_dir() call
+#endif
+#define ESCAPE_LOOP_US 1000         // time between bumper checks going forward
 
 /* alt_main alias */
 int main (void) __attribute__ ((weak, alias ("alt_main")));
@@ -55,37 +72,40 @@ int alt_main()
      */
     alt_u32 inputs, front_bumpers;
     /* standard integer declarations */
-    int random, count, dir;
+    int random, count = 0, dir;
     /* Turns motors and step motors on - v important - Robot won't work if this isn't included.
      * This sets the direction for bits on the expansion header. A ‘1’ means it’s writable ‘0’ readable. This is vital!
      */ 
     IOWR_ALTERA_AVALON_PIO_DIRECTION(EXPANSION_JP1_BASE, 0xF000000F);
     
+    // Inner loop takes over the header, stops going forward into anything the bumpers hit
+    controlStart(FRONT_BUMPERS, CONTROL_NO_ADC);
+    
     // seed for rand()
     srand(time(NULL));
     
     while(1){
         
         // Read all components of robot
-        inputs = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+        inputs = controlInputs();
         // Target specific parts of the robots
         front_bumpers = (~inputs) & FRONT_BUMPERS;
         
         if(!front_bumpers)  // Keep forward while both front bumpers not activated
-            forward(6000);
+            forward(ESCAPE_FORWARD_DUTY);
         else{
-            IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE, BACKWARD);
-            usleep(10000); // Reverse time - stops it to be able to turn
+            controlSetMotors(BACKWARD, CONTROL_DUTY_FULL);
+            usleep(controlMotionUs(10000, CONTROL_DUTY_FULL)); // Reverse time - stops it to be able to turn
         
             switch(front_bumpers){
                 /* If both front bumpers are on */
-                case FRONT_BUMPERS      :   random = rand() % 2;    // randomly choose between 0/1 (to decide direction)
+                case FRONT_BUMPERS      :   random = recorderValue(rand()) % 2;    // randomly choose between 0/1 (to decide direction)
                     
                                             // while both front bumpers are still on, keep turning
                                             while(front_bumpers){
                                                 rotate_dir(random);
                                                 // Reset values for next iteration
-                                                inputs = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+                                                inputs = controlInputs();
                                                 front_bumpers = (~inputs) & FRONT_BUMPERS;
                                             }
                                             break;
@@ -104,7 +124,7 @@ int alt_main()
                                                 }
                                                 rotate_dir(dir);
                                                 // Reset values for next iteration
-                                                inputs = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+                                                inputs = controlInputs();
                                                 front_bumpers = (~inputs) & FRONT_BUMPERS;
                                                 count++;
                                             }
@@ -115,7 +135,7 @@ int alt_main()
                                             while(front_bumpers){
                                                 rotate_dir(0);  // turn left
                                                 // Reset values for next iteration
-                                                inputs = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+                                                inputs = controlInputs();
                                                 front_bumpers = (~inputs) & FRONT_BUMPERS;
                                                 count++;
                                             }
@@ -136,21 +156,14 @@ int alt_main()
  * Date Created         : 02/02/17
  * Description          : PWM function to control the speed that the robot moves
  *                        forward. The higher the value that is passed through,
- *                        the faster the robot moves. 0 - 10000.
+ *                        the faster the robot moves. 0 - 10000. The inner loop
+ *                        does the switching, this sets the duty and waits for
+ *                        one pass.
  *******************************************************************************/
  
 void forward(int x){
-    int y = 10000-x,i=0;
-    while(x>i){
-        IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE, FORWARD);//go forward
-        i++;
-    }
-    i=0;
-    while(y>i){
-        IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE, 0xC);
-        i++;
-    }
-    
+    controlSetMotors(FORWARD, x * CONTROL_DUTY_FULL / 10000);//go forward
+    usleep(ESCAPE_LOOP_US);
 }
 
 
@@ -173,6 +186,6 @@ void rotate_dir(int direction){
         direction = ROTATE_RIGHT;
     else
         direction = ROTATE_LEFT;
-    IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE, direction); // need to randomise this
-    usleep(50000); // Amount of rotation - smaller for more 'finesse'
+    controlSetMotors(direction, CONTROL_DUTY_FULL); // need to randomise this
+    usleep(controlMotionUs(ESCAPE_ROTATE_US, CONTROL_DUTY_FULL)); // Amount of rotation - smaller for more 'finesse'
 }    
@@ -0,0 +1,224 @@
+/*****************************************************************
+* Module name: EventQueue
+*
+* Copyright 1997 Company as an unpublished work.
+* All Rights Reserved.
+*
+* The information contained herein is confidential
+* property of Company. The user, copying, transfer or
+* disclosure of such information is prohibited except
+* by express written agreement with Company.
+*
+* First written on 19/10/26 by Connor Parker.
+*
+* Module Description:
+* -------------------
+* Single producer / single consumer event queue, see
+* EventQueue.h for how it is meant to be used.
+*
+*****************************************************************
+*  Includes section
+*****************************************************************/
+
+/* Standard Altera include files to enable the mapping of names
+To hardware addresses etc. */
+#include "system.h"
+#include "altera_avalon_pio_regs.h"
+#include "alt_types.h"
+#include "sys/alt_irq.h"
+#include "sys/alt_timestamp.h"
+
+#include "EventQueue.h"
+#include "Recorder.h"
+
+/*****************************************************************
+*  Defines section
+*****************************************************************/
+
+/* Stops the compiler moving memory accesses across this point.
+ * The Nios II is a single core so this is all the ordering the
+ * ISR and main loop need between filling a slot and publishing it */
+#define COMPILER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+#define EVENT_QUEUE_MASK (EVENT_QUEUE_SIZE - 1)
+
+/*****************************************************************
+*  Function Prototype Section
+*****************************************************************/
+
+static void jp1EdgeIsr(void *context);
+
+/****************************************************************/
+
+/****************************************************************
+* Function name     : eventQueueInit
+*    returns        : void
+*    arg1           : queue - queue to empty
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Empties the queue and clears the dropped
+*                     count. Must be called before the producer
+*                     ISR is enabled.
+* Notes             : n/a
+****************************************************************/
+void eventQueueInit(EventQueue *queue)
+{
+    queue->head    = 0;
+    queue->tail    = 0;
+    queue->dropped = 0;
+}
+
+/****************************************************************
+* Function name     : eventQueuePost
+*    returns        : TRUE (1) if the event was queued, FALSE (0)
+*                     if the queue was full and it was dropped
+*    arg1           : queue - queue to add to
+*    arg2           : event - event to copy into the queue
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Producer side. Copies the event into the
+*                     next free slot then publishes it by moving
+*                     head on.
+* Notes             : Only ever call from the one producer,
+*                     normally the ISR
+****************************************************************/
+alt_u8 eventQueuePost(EventQueue *queue, const SensorEvent *event)
+{
+    alt_u32 head;
+
+    head = queue->head;
+
+    /* full when the producer is a whole queue ahead of the consumer */
+    if ((head - queue->tail) >= EVENT_QUEUE_SIZE)
+    {
+        queue->dropped++;
+
+        return 0;
+    }
+
+    queue->events[head & EVENT_QUEUE_MASK] = *event;
+
+    /* slot must be written before the consumer can see it */
+    COMPILER_BARRIER();
+
+    queue->head = head + 1;
+
+    return 1;
+}
+
+/****************************************************************
+* Function name     : eventQueueTake
+*    returns        : TRUE (1) if an event was read, FALSE (0) if
+*                     the queue was empty
+*    arg1           : queue - queue to read from
+*    arg2           : event - filled with the oldest event
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Consumer side. Copies out the oldest event
+*                     then frees its slot by moving tail on.
+* Notes             : Only ever call from the one consumer,
+*                     normally the main loop. Interrupts stay
+*                     enabled the whole time. What is taken is
+*                     recorded, see Recorder.h
+****************************************************************/
+alt_u8 eventQueueTake(EventQueue *queue, SensorEvent *event)
+{
+    alt_u32 tail;
+
+    tail = queue->tail;
+
+    if (tail == queue->head)
+    {
+        return recorderEvent(0, event);
+    }
+
+    /* head must be read before the slot it published */
+    COMPILER_BARRIER();
+
+    *event = queue->events[tail & EVENT_QUEUE_MASK];
+
+    /* slot must be copied out before the producer can reuse it */
+    COMPILER_BARRIER();
+
+    queue->tail = tail + 1;
+
+    return recorderEvent(1, event);
+}
+
+/****************************************************************
+* Function name     : eventQueueCount
+*    returns        : number of events waiting to be read
+*    arg1           : queue - queue to check
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Snapshot of how full the queue is
+* Notes             : May already be out of date when it returns
+*                     if the ISR fires
+****************************************************************/
+alt_u32 eventQueueCount(const EventQueue *queue)
+{
+    return queue->head - queue->tail;
+}
+
+/****************************************************************
+* Function name     : jp1EventsStart
+*    returns        : void
+*    arg1           : queue - queue the ISR will post events to
+*    arg2           : mask - header bits that should raise an
+*                     event when they change, e.g.
+*                     LEFT_FLOOR_SENSOR | RIGHT_FLOOR_SENSOR
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Empties the queue, starts the timestamp
+*                     timer and enables the edge capture
+*                     interrupt of the expansion header so every
+*                     change of a masked bit is posted
+* Notes             : Call once at start up after the header
+*                     direction has been set
+****************************************************************/
+void jp1EventsStart(EventQueue *queue, alt_u32 mask)
+{
+    eventQueueInit(queue);
+
+    alt_timestamp_start();
+
+    /* clear any edges caught before we were listening */
+    IOWR_ALTERA_AVALON_PIO_EDGE_CAP(EXPANSION_JP1_BASE, 0xFFFFFFFF);
+
+    alt_ic_isr_register(EXPANSION_JP1_IRQ_INTERRUPT_CONTROLLER_ID,
+                        EXPANSION_JP1_IRQ, jp1EdgeIsr, queue, 0x0);
+
+    IOWR_ALTERA_AVALON_PIO_IRQ_MASK(EXPANSION_JP1_BASE, mask);
+}
+
+/****************************************************************
+* Function name     : jp1EdgeIsr
+*    returns        : void
+*    arg1           : context - the EventQueue passed to
+*                     jp1EventsStart
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Runs on any edge of an enabled header bit.
+*                     Posts which bits changed along with the
+*                     header value and the time.
+* Notes             : Edge capture is cleared first so an edge
+*                     during the ISR raises a new interrupt
+*                     rather than being lost
+****************************************************************/
+static void jp1EdgeIsr(void *context)
+{
+    EventQueue *queue;
+    SensorEvent event;
+
+    queue = (EventQueue *)context;
+
+    event.timestamp = alt_timestamp();
+
+    /* read which bits changed and clear them */
+    event.changed = IORD_ALTERA_AVALON_PIO_EDGE_CAP(EXPANSION_JP1_BASE);
+    IOWR_ALTERA_AVALON_PIO_EDGE_CAP(EXPANSION_JP1_BASE, event.changed);
+
+    event.header = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+
+    eventQueuePost(queue, &event);
+}
@@ -0,0 +1,86 @@
+/*****************************************************************
+* Module name: EventQueue
+*
+* Copyright 1997 Company as an unpublished work.
+* All Rights Reserved.
+*
+* The information contained herein is confidential
+* property of Company. The user, copying, transfer or
+* disclosure of such information is prohibited except
+* by express written agreement with Company.
+*
+* First written on 19/10/26 by Connor Parker.
+*
+* Module Description:
+* -------------------
+* Fixed size queue of timestamped sensor events passed from an
+* interrupt service routine to the behaviour loop.
+*
+*    Exactly one producer (the ISR) and one consumer (the main
+*    loop) so neither side needs locks or to mask interrupts
+*
+*    Memory is fixed at EVENT_QUEUE_SIZE events, if the consumer
+*    falls behind new events are counted as dropped rather than
+*    overwriting ones not yet read
+*
+*    jp1EventsStart() hooks the edge capture interrupt of the
+*    expansion header PIO so every change of a sensor bit is
+*    posted in order with the time it happened
+*
+* The EXPANSION_JP1 PIO must be generated with edge capture
+* (any edge) and IRQ enabled, and the BSP needs a timestamp
+* timer for the event times.
+*
+*****************************************************************/
+
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include "alt_types.h"
+
+/*****************************************************************
+*  Defines section
+*****************************************************************/
+
+/* Number of events held, must be a power of 2 */
+#define EVENT_QUEUE_SIZE 64
+
+/*****************************************************************
+*  Types section
+*****************************************************************/
+
+typedef struct
+{
+    alt_u32 timestamp;  /* alt_timestamp() when the event was caught */
+    alt_u32 header;     /* value of the header at that moment        */
+    alt_u32 changed;    /* header bits that saw an edge              */
+} SensorEvent;
+
+typedef struct
+{
+    /* head is only written by the producer and tail only by the
+     * consumer, both count up forever and are masked on use */
+    volatile alt_u32 head;
+    volatile alt_u32 tail;
+
+    /* events lost because the queue was full, producer owned */
+    volatile alt_u32 dropped;
+
+    SensorEvent events[EVENT_QUEUE_SIZE];
+} EventQueue;
+
+/*****************************************************************
+*  Function Prototype Section
+*****************************************************************/
+
+void eventQueueInit(EventQueue *queue);
+
+alt_u8 eventQueuePost(EventQueue *queue, const SensorEvent *event);
+
+alt_u8 eventQueueTake(EventQueue *queue, SensorEvent *event);
+
+alt_u32 eventQueueCount(const EventQueue *queue);
+
+void jp1EventsStart(EventQueue *queue, alt_u32 mask);
+
+#endif
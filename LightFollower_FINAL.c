@@ -33,6 +33,22 @@
 *
 *   Stops at an obstacle                    YES
 *
+* Sensing, motor PWM and stopping at an obstruction run in the
+* Control inner loop, this module is the behaviour on top.
+*
+* Each sample is tagged with the bearing it was taken at, eye
+* angle plus the heading the robot has turned to since start, so
+* a cone whose edges are seen either side of a turn still gives
+* the right middle. The middles go through an alpha-beta filter
+* (LIGHT_BEARING_*) and turns are made on the filtered bearing.
+* A sweep that misses the cone turns on the bearing predicted
+* from the filter instead of carrying on blind.
+*
+* Turns up to LIGHT_PIVOT_ABOVE_US are steered, the forward part
+* of each step runs on a curve until the turn is made, so the
+* robot keeps moving and scanning while it corrects. Only bigger
+* turns stop to pivot.
+*
 *****************************************************************
 *  Includes section
 *****************************************************************/
@@ -46,17 +62,26 @@ To hardware addresses etc. */
 #include <unistd.h>
 #include <stdio.h>
 
+#include "Control.h"
+#include "Telemetry.h"
+#include "Recorder.h"
+
+/* Tuned timings generated by host/autotune, see the Tuning section */
+#ifdef USE_TUNED_PARAMS
+#include "TunedParams.h"
+#endif
+
 /*****************************************************************
 *  Defines section
 *****************************************************************/
 
 /* Directions */
-#define STOP             0xFFFFFFFC
-#define FORWARD           0xFFFFFFFF
-#define LEFT_ONE_MOTOR   0xFFFFFFFA
-#define RIGHT_ONE_MOTOR  0xFFFFFFF5
-#define LEFT_BOTH_MOTOR  0xFFFFFFFB
-#define RIGHT_BOTH_MOTOR 0xFFFFFFF7
+#define STOP             0xC
+#define FORWARD          0xF
+#define LEFT_ONE_MOTOR   0xA
+#define RIGHT_ONE_MOTOR  0x5
+#define LEFT_BOTH_MOTOR  0xB
+#define RIGHT_BOTH_MOTOR 0x7
 
 /* Sensors */
 #define LEFT_FLOOR_SENSOR  0x4000
@@ -68,26 +93,110 @@ To hardware addresses etc. */
 #define LEFT_EYE_SWITCH   0x20000
 #define RIGHT_EYE_SWITCH  0x10000
 
-/* Flags for reading ADC */
-#define START_FLAG 0x8000         
-#define DONE_FLAG  0x8000    
+/* Header bits worth sending in telemetry */
+#define SENSOR_MASK (LEFT_FRONT_BUMPER | RIGHT_FRONT_BUMPER | LEFT_EYE_SWITCH | RIGHT_EYE_SWITCH)
+
+/* Telemetry states */
+#define STATE_SCAN_RIGHT 0    /* same values as direction */
+#define STATE_SCAN_LEFT  1
+#define STATE_IN_CONE    2
+
+/* Tuning - defaults are the values found by hand,
+ * defining USE_TUNED_PARAMS takes them from TunedParams.h instead */
+#ifndef LIGHT_ADC_SETTLE_US
+#define LIGHT_ADC_SETTLE_US  2500     /* stopped while the ADC reads each step */
+#endif
+#ifndef LIGHT_DRIVE_US
+#define LIGHT_DRIVE_US       1500     /* driving forward each step */
+#endif
+#ifndef LIGHT_THRESHOLD
+#define LIGHT_THRESHOLD      300      /* ADC value counted as inside the light cone */
+#endif
+#ifndef LIGHT_TURN_HARD_US
+#define LIGHT_TURN_HARD_US   260000   /* roughly 90 degrees */
+#endif
+#ifndef LIGHT_TURN_WIDE_US
+#define LIGHT_TURN_WIDE_US   180000
+#endif
+#ifndef LIGHT_TURN_MEDIUM_US
+#define LIGHT_TURN_MEDIUM_US 100000
+#endif
+#ifndef LIGHT_TURN_SOFT_US
+#define LIGHT_TURN_SOFT_US   30000
+#endif
+
+/* Bearing filter, fractions are sixteenths */
+#ifndef LIGHT_BEARING_ALPHA
+#define LIGHT_BEARING_ALPHA     8        /* of a residual taken into the bearing */
+#endif
+#ifndef LIGHT_BEARING_BETA
+#define LIGHT_BEARING_BETA      2        /* of a residual taken into its rate */
+#endif
+#ifndef LIGHT_BEARING_FORGET_US
+#define LIGHT_BEARING_FORGET_US 3000000  /* estimate older than this is dropped */
+#endif
+
+/* ages are kept in control ticks, in us they would wrap after 71 minutes */
+#define LIGHT_BEARING_FORGET_TICKS (LIGHT_BEARING_FORGET_US / CONTROL_TICK_US)
+
+/* Steering */
+#ifndef LIGHT_PIVOT_ABOVE_US
+#define LIGHT_PIVOT_ABOVE_US    150000   /* turns bigger than this pivot on the spot */
+#endif
+#ifndef LIGHT_ARC_CURVE
+#define LIGHT_ARC_CURVE         100      /* curve smaller turns are steered on */
+#endif
+
+/* ADC channel of the light sensor */
+#define LIGHT_ADC_CHANNEL 1
 
 /* BOOLEAN */
 #define FALSE 0
 #define TRUE  1
 
+/*****************************************************************
+*  Types section
+*****************************************************************/
+
+/* Angles are held as how long a pivot at the nominal battery
+ * voltage takes to turn through them, LIGHT_TURN_HARD_US being
+ * 90 degrees, so a bearing can be passed to makeTurn() as it is.
+ * Left is positive */
+typedef struct
+{
+    alt_32  heading;    /* turned since start, from makeTurn()      */
+    alt_32  bearing;    /* light, same frame as heading             */
+    alt_32  rate;       /* change of bearing per second             */
+    alt_u32 updated;    /* controlTicks() of the last measurement   */
+    alt_u8  valid;
+    alt_32  arc;        /* turn still to be steered, from makeTurn() */
+} BearingEstimate;
+
 /*****************************************************************
 *  Function Prototype Section
 *****************************************************************/
 
 void checkObstruction(void);
 
-alt_u16 read_adc(alt_u8 channel);
-
 void makeTurn(alt_u32 direction, int duration);
 
 void calcTurn(int light_start, int light_end, int current_dir_start, int current_dir_end, alt_u32 totalSteps);
 
+int sampleBearing(alt_u32 currentStep, alt_u32 totalSteps);
+
+void bearingMeasured(int bearing, alt_u8 restart);
+
+alt_u8 steerOnEstimate(void);
+
+void driveStep(void);
+
+/*****************************************************************
+*  Global Variables Section
+*****************************************************************/
+
+/* Where the light is thought to be */
+BearingEstimate estimate;
+
 /****************************************************************/
 
 int main()
@@ -96,16 +205,17 @@ int main()
      * the Marco hardware */
     alt_u32 output, header, totalSteps, currentStep;
 
-    alt_u32 steps[8] = { 0x8FFFFFFF,
-                         0x9FFFFFFF,
-                         0x1FFFFFFF,
-                         0x5FFFFFFF,
-                         0x4FFFFFFF,
-                         0x6FFFFFFF,
-                         0x2FFFFFFF,
-                         0xAFFFFFFF };
-
-    alt_u8 direction;
+    /* stepper coil patterns for header bits 28-31 */
+    alt_u32 steps[8] = { 0x8,
+                         0x9,
+                         0x1,
+                         0x5,
+                         0x4,
+                         0x6,
+                         0x2,
+                         0xA };
+
+    alt_u8 direction, coneSeen;
     int stepNum, light, light_start, light_end, first_below_200, current_dir_start, current_dir_end, light_middle, light_previous, light_total, light_half;
     float percent;
 
@@ -128,28 +238,31 @@ int main()
     light_total = -50;
     light_previous = -50;
     direction = 1;
+    coneSeen = FALSE;
+
+    estimate.heading = 0;
+    estimate.valid   = FALSE;
+    estimate.arc     = 0;
     
-    /* initialise outputs to STOP */
+    telemetryInit(1, SENSOR_MASK);
+
+    /* initialise outputs to STOP, the inner loop takes over the header
+     * and the light sensor, stopping for the bumpers */
     output = STOP;
-    /* pass initialised inputs to header */
-    IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,output);
+    controlStart(LEFT_FRONT_BUMPER | RIGHT_FRONT_BUMPER, LIGHT_ADC_CHANNEL);
     
     /* initialisation - turn light sensor left until it hits the left switch */
     while(direction == 1)
     {
         for(stepNum = 0; stepNum < 8; stepNum++)
         {
-            /* bitwise OR to wipe stepper section of output while maintaining motor values */
-            output |= 0xFFFFFFF0;
-            /* bitwise AND applys steps[] value to ouput while still maintaining motor values */
-            output &= (steps[stepNum]);
-            /* Apply output variable to header to control stepper motor */
-            IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,output);
+            /* Apply steps[] value to the stepper motor, motors are left as they are */
+            controlSetStepper(steps[stepNum]);
 
             usleep(2000);
 
             /* read value of header into header variable*/
-            header = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+            header = controlInputs();
             /* when left switch hit, change direction */
             if (!(header & LEFT_EYE_SWITCH))
             {
@@ -167,17 +280,13 @@ int main()
             /* increment for each step */
             totalSteps++;
             
-            /* bitwise OR to wipe stepper section of output while maintaining motor values */
-            output |= 0xFFFFFFF0;
-            /* bitwise AND applys steps[] value to ouput while still maintaining motor values */
-            output &= (steps[stepNum]);
-            /* Apply output variable to header to control stepper motor */
-            IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,output);
+            /* Apply steps[] value to the stepper motor, motors are left as they are */
+            controlSetStepper(steps[stepNum]);
 
             usleep(2000);
 
             /* read value of header into header variable*/
-            header = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+            header = controlInputs();
             /* when right switch hit, change direction */
             if (!(header & RIGHT_EYE_SWITCH))
             {
@@ -198,52 +307,60 @@ int main()
                 
                 output = STOP; 
                           
-                /* bitwise OR to wipe stepper section to allow steps[] to be applied to output while maintaining motor values */
-                output |= 0xFFFFFFF0;
-                /* bitwise AND applys steps[] value to ouput while still maintaining motor values */
-                output &= (steps[stepNum]);
-                /*Apply output variable to header to control stepper motor */
-                IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,output);
-
-                // reads the adc on the bot - get light value
-                light = read_adc(1);
-                // allows adc to finish reading
-                usleep(2500);
+                /* stop and apply steps[] value to the stepper motor */
+                controlSetMotors(output, 0);
+                controlSetStepper(steps[stepNum]);
+
+                // allows the eye to settle while the inner loop samples it
+                usleep(LIGHT_ADC_SETTLE_US);
+                // get light value
+                light = controlAdc();
                 
-                output = FORWARD & steps[stepNum];
+                output = FORWARD;
 
-                IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,output);
-
-                usleep(1500);
+                /* forward, on a curve while a turn is being steered */
+                driveStep();
                 
                 /* 
                  * Only enter if light value exceeds threshold and end value not yet found
                  */
-                if((light > 300) && (first_below_200 == FALSE)){
-                    light_start = currentStep;
+                if((light > LIGHT_THRESHOLD) && (first_below_200 == FALSE)){
+                    light_start = sampleBearing(currentStep, totalSteps);
                     current_dir_start = direction;  
                     first_below_200 = TRUE;                         
                 }
                 /* 
                  * Only enter if light value drops below threshold and start value has been found 
                  */
-                if((light < 300) && (first_below_200 == TRUE)){
-                    light_end = currentStep;
+                if((light < LIGHT_THRESHOLD) && (first_below_200 == TRUE)){
+                    light_end = sampleBearing(currentStep, totalSteps);
                     current_dir_end = direction;  
                     first_below_200 = FALSE;
                     /* calculate amount to turn depending on position of light cone */   
                     calcTurn(light_start, light_end, current_dir_start, current_dir_end, totalSteps);
+                    coneSeen = TRUE;
                     /* reset values for next loop */
                     light_start = -50;
                     light_end = -50; 
                 }
               
                 /* read value of header into header variable*/
-                header = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+                header = controlInputs();
+
+                /* queue a telemetry record, never waits for the UART */
+                telemetryRecord(header & SENSOR_MASK, output, stepNum, light,
+                                first_below_200 ? STATE_IN_CONE : direction);
+
                 if (!(header & LEFT_EYE_SWITCH))
                 {
                     /* start turning right */
                     direction = 0;
+                    /* missed the cone this sweep, go on the prediction */
+                    if (!coneSeen && !first_below_200)
+                    {
+                        steerOnEstimate();
+                    }
+                    coneSeen = FALSE;
                     /* re-initialise value to account for discrepancies caused by hardware */
                     currentStep = totalSteps;
                 }
@@ -260,53 +377,60 @@ int main()
                 
                 output = STOP;
                 
-                /* bitwise OR to wipe stepper section of output while maintaining motor values */
-                output |= 0xFFFFFFF0;
-                /* bitwise AND applys steps[] value to ouput while still maintaining motor values */
-                output &= (steps[stepNum]);
-
-                /*Apply output variable to header to control stepper motor */
-                IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,output);
+                /* stop and apply steps[] value to the stepper motor */
+                controlSetMotors(output, 0);
+                controlSetStepper(steps[stepNum]);
                 
-                // reads the adc on the bot 
-                light = read_adc(1);
-                //allows adc to finish reading will probably cause problems if lowered definately causes problems if zero
-                usleep(2500);
+                //allows the eye to settle while the inner loop samples it, will probably cause problems if lowered
+                usleep(LIGHT_ADC_SETTLE_US);
+                // get light value
+                light = controlAdc();
                 
-                output = FORWARD & steps[stepNum];
+                output = FORWARD;
 
-                IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,output);
-                
-                usleep(1500);  
+                /* forward, on a curve while a turn is being steered */
+                driveStep();
                           
                 /* 
                  * Only enter if light value exceeds threshold and end value not yet found
                  */
-                if((light > 300) && (first_below_200 == FALSE)){
-                    light_start = currentStep;
+                if((light > LIGHT_THRESHOLD) && (first_below_200 == FALSE)){
+                    light_start = sampleBearing(currentStep, totalSteps);
                     current_dir_start = direction;  
                     first_below_200 = TRUE;                         
                 }                
                 /* 
                  * Only enter if light value drops below threshold and start value has been found 
                  */
-                if((light < 300) && (first_below_200 == TRUE)){
-                    light_end = currentStep;
+                if((light < LIGHT_THRESHOLD) && (first_below_200 == TRUE)){
+                    light_end = sampleBearing(currentStep, totalSteps);
                     current_dir_end = direction;  
                     first_below_200 = FALSE;
                     /* calculate amount to turn depending on position of light cone */   
                     calcTurn(light_start, light_end, current_dir_start, current_dir_end, totalSteps);
+                    coneSeen = TRUE;
                     /* reset values for next loop */
                     light_start = -50;
                     light_end = -50; 
                 }
                    
                 /* read value of header into header variable*/
-                header = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+                header = controlInputs();
+
+                /* queue a telemetry record, never waits for the UART */
+                telemetryRecord(header & SENSOR_MASK, output, stepNum, light,
+                                first_below_200 ? STATE_IN_CONE : direction);
+
                 if (!(header & RIGHT_EYE_SWITCH))
                 {
                     /* start turning left */
                     direction = 1;
+                    /* missed the cone this sweep, go on the prediction */
+                    if (!coneSeen && !first_below_200)
+                    {
+                        steerOnEstimate();
+                    }
+                    coneSeen = FALSE;
                     /* re-initialise value to account for discrepancies caused by hardware */
                     currentStep = 0;
                 }
@@ -337,24 +461,26 @@ void checkObstruction()
     alt_u32 header;
 
     alt_u8 blocked;
-    
-    IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,STOP);    
 
-    /* read value of header into header variable*/        
-    header = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+    /* read value of header into header variable, the inner loop
+     * has already stopped the motors if a bumper is pressed*/        
+    header = controlInputs();
 
     /* if either front sensor detects a blockage enter if*/
-    if (((header & LEFT_FRONT_BUMPER ) != 32768) || ((RIGHT_FRONT_BUMPER & 0x800) != 2048))
+    if (((header & LEFT_FRONT_BUMPER ) != 32768) || ((header & RIGHT_FRONT_BUMPER) != 2048))
     {
         blocked = 1;
 
+        /* stay still until it is removed */
+        controlSetMotors(STOP, 0);
+
         while(blocked == 1)
         {
 
             /* read value of header into header variable*/        
-            header = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);        
+            header = controlInputs();        
 
-            if (((header & LEFT_FRONT_BUMPER ) == 32768) && ((RIGHT_FRONT_BUMPER & 0x800) == 2048))   
+            if (((header & LEFT_FRONT_BUMPER ) == 32768) && ((header & RIGHT_FRONT_BUMPER) == 2048))   
             {
                 blocked = 0;
             }
@@ -366,155 +492,312 @@ void checkObstruction()
 }
 
 
-/****************************************************************
-* Function name     : read_adc
-*    returns        : alt_u16 of value returned by adc
-*    arg1           : channel*                     
-* Created by        : Ian Johnson
-* Date created      : 25/3/17
-* Description       : Makes request to bot to convert analogue
-*                     light sensor into binary output*                     
-* Notes             : n/a                     
-****************************************************************/
-alt_u16 read_adc(alt_u8 channel)
-{
-    
-    alt_u16 data, digitalvalue = 0;
-    int done = FALSE;
-    const int maxwait = 1000;
-    int waitcount = 0;
-    
-    // initialise ADC
-    data = channel;
-    IOWR(ADC_SPI_READ_BASE, 0, data);       // specify channel
-    data |= START_FLAG;                     // data OR START FLAG
-    IOWR(ADC_SPI_READ_BASE, 0, data);       // tell ADC to start
-    //usleep(10000);                          // wait 10ms
-    
-    // wait until finished
-    while(!done && (waitcount++ <= maxwait))
-    {
-        data = IORD(ADC_SPI_READ_BASE,0);   // has the ADC finished?
-        done = (data & DONE_FLAG)  ? TRUE : FALSE;
-    }
-    
-    /* 12 bit ADC, 4 bits for control, so clear the top 4 */
-    if (done)
-        digitalvalue = data & 0xFFF;        
-
-    IOWR(ADC_SPI_READ_BASE, 0, 0);          // tell ADC to stop
-    return digitalvalue;                    // return the result
-}
-
 /****************************************************************
 * Function name     : makeTurn
 *    returns        : void                     
 *    arg1           : direction - hex value to be passed to header
-*    arg2           : duration - amount to turn*                     
+*    arg2           : duration - amount to turn at the nominal
+*                     battery voltage, see controlMotionUs()
 * Created by        : Connor Parker
 * Date created      : 25/03/17
-* Description       : Turn towards direction specified by inputs.                    
+* Description       : Turn towards direction specified by inputs.
+*                     Up to LIGHT_PIVOT_ABOVE_US the turn is handed
+*                     to driveStep() to steer, bigger ones pivot
+*                     here.
 * Notes             : Used as function as used many time, despite
-*                     being short                     
+*                     being short. Every turn goes through here so
+*                     the estimated heading follows it.
 ****************************************************************/
 void makeTurn(alt_u32 direction, int duration)
 {
-    IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,direction);
+    if (duration <= LIGHT_PIVOT_ABOVE_US)
+    {
+        estimate.arc += (direction == LEFT_BOTH_MOTOR) ? duration : -duration;
+
+        return;
+    }
 
-    usleep(duration);
+    estimate.heading += (direction == LEFT_BOTH_MOTOR) ? duration : -duration;
 
-    IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,0x0FFFFFFF);
+    controlSetMotors(direction, CONTROL_DUTY_FULL);
+
+    usleep(controlMotionUs(duration, CONTROL_DUTY_FULL));
+
+    /* carry on forward with the stepper coils released */
+    controlSetMotors(FORWARD, CONTROL_DUTY_FULL);
+    controlSetStepper(0x0);
 }
 
 
 /****************************************************************
 * Function name     : calcTurn
 *    returns        : void                     
-*    arg1           : light_start - when light threshold first exceeded                     
-*    arg2           : light_end - when light threshold goes below                     
+*    arg1           : light_start - bearing light threshold first exceeded at
+*    arg2           : light_end - bearing light went below threshold at
 *    arg3           : current_dir_start - direction when light threshold first exceeded                   
 *    arg4           : current_dir_end - direction when light goes below threshold                    
 *    arg5           : totalSteps - steps from left to right of sensor recorded during initialisation                     
 * Created by        : Connor Parker
 * Date created      : 25/03/17
-* Description       : Calculating mid-point of light cone. 
-*                     Calls makeTurn, passing values calculated                    
-* Notes             : n/a                     
+* Description       : Calculating mid-point of light cone, which is
+*                     fed to the bearing estimate. Then turns to
+*                     where the estimate says the light is.
+* Notes             : Bearings come from sampleBearing() so the
+*                     turns made between the two are allowed for
 ****************************************************************/
 void calcTurn(int light_start, int light_end, int current_dir_start, int current_dir_end, alt_u32 totalSteps)
 {
-    /* declare variables */
-    int light_total, light_half, light_middle;
-    float percent; 
-    
-    /* if edge of cone is beyond boundry of sensor, make 90 degree turn in appropriate direction */
+    (void)totalSteps;
+
+    /* if edge of cone is beyond boundry of sensor, the light is
+     * past the end stop so start the estimate again from there,
+     * which makes a 90 degree turn in appropriate direction */
     if(current_dir_start != current_dir_end){
         if(current_dir_start == 1){
-            makeTurn(LEFT_BOTH_MOTOR, 260000);    
+            bearingMeasured(estimate.heading + LIGHT_TURN_HARD_US, TRUE);
         }
         else{
-            makeTurn(RIGHT_BOTH_MOTOR, 260000);
+            bearingMeasured(estimate.heading - LIGHT_TURN_HARD_US, TRUE);
         }
-        current_dir_start = current_dir_end; 
     }
-    /* if start and end found, calculate middle of cone */    
-    else if((!(light_start == -50) && (!(light_end == -50))) == TRUE){
-        if(light_start > light_end){
-            light_total = light_start - light_end;
-            light_half = light_total / 2;  
-            light_middle = light_end + light_half;       
-        }
-        else{
-            light_total = light_end - light_start;
-            light_half = light_total / 2;
-            light_middle = light_start + light_half;
-        }
-        
-        /* allow for differences between bots */      
-        percent = (((float)light_middle / (float)totalSteps) * 100);
-        
-        /* determines how much to turn depending on where middle of cone is */
-        // hard left 
-        if ((percent <= 100) && (percent >= 90))
-        {
-            makeTurn(LEFT_BOTH_MOTOR,260000);
-        } 
-        else if ((percent <= 91) && (percent >= 80))
-        {
-            makeTurn(LEFT_BOTH_MOTOR,180000);
-        } 
-        else if ((percent <= 81) && (percent >= 56))
-        {
-            makeTurn(LEFT_BOTH_MOTOR,100000);
-        } 
-        // soft left
-        else if ((percent <= 55) && (percent >= 50))
+    /* start and end found, middle of cone */
+    else{
+        bearingMeasured(light_start + (light_end - light_start) / 2, FALSE);
+    }
+
+    steerOnEstimate();
+}
+
+
+/****************************************************************
+* Function name     : sampleBearing
+*    returns        : bearing the eye is looking along
+*    arg1           : currentStep - eye position, 0 at the right
+*                     switch
+*    arg2           : totalSteps - steps from right switch to left
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Eye angle from straight ahead, taking the
+*                     sweep as 180 degrees, plus the heading
+* Notes             : Same units and frame as BearingEstimate
+****************************************************************/
+int sampleBearing(alt_u32 currentStep, alt_u32 totalSteps)
+{
+    if (totalSteps == 0)
+    {
+        return estimate.heading;
+    }
+
+    return estimate.heading +
+           (((int)(2 * currentStep) - (int)totalSteps) * LIGHT_TURN_HARD_US) / (int)totalSteps;
+}
+
+
+/****************************************************************
+* Function name     : bearingMeasured
+*    returns        : void
+*    arg1           : bearing - middle of a cone just seen
+*    arg2           : restart - TRUE (1) to take it as it is
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Alpha-beta filter. The bearing is predicted
+*                     forward to now at the current rate, then both
+*                     are pulled towards the measurement by
+*                     LIGHT_BEARING_ALPHA and LIGHT_BEARING_BETA.
+*                     The rate is how the light moves round as
+*                     the robot drives past it.
+* Notes             : A stale estimate is restarted, the rate is
+*                     kept to 90 degrees a second
+****************************************************************/
+void bearingMeasured(int bearing, alt_u8 restart)
+{
+    alt_u32 now, age, ms;
+    alt_32 predicted, residual;
+    alt_64 rate;
+
+    now = recorderValue(controlTicks());
+    age = now - estimate.updated;
+
+    if (restart || !estimate.valid || (age > LIGHT_BEARING_FORGET_TICKS) ||
+        (age * CONTROL_TICK_US < 1000))
+    {
+        estimate.bearing = bearing;
+        estimate.rate    = 0;
+    }
+    else
+    {
+        /* no older than the forget time, so ms cannot wrap */
+        ms = (age * CONTROL_TICK_US) / 1000;
+
+        /* rate times ms passes 32 bits well inside the forget time */
+        predicted = estimate.bearing + (alt_32)(((alt_64)estimate.rate * ms) / 1000);
+        residual  = bearing - predicted;
+
+        estimate.bearing = predicted + (residual * LIGHT_BEARING_ALPHA) / 16;
+
+        rate = estimate.rate + (((alt_64)residual * LIGHT_BEARING_BETA) / 16) * 1000 / ms;
+
+        if (rate > LIGHT_TURN_HARD_US)
         {
-            makeTurn(LEFT_BOTH_MOTOR,30000);
+            rate = LIGHT_TURN_HARD_US;
         }
-        // soft right
-        else if ((percent <= 40) && (percent >= 35))
-        {
-            makeTurn(RIGHT_BOTH_MOTOR,30000);
-        } 
-        else if ((percent <= 34) && (percent >= 21))
+        else if (rate < -LIGHT_TURN_HARD_US)
         {
-            makeTurn(RIGHT_BOTH_MOTOR,100000);
-        } 
-        else if ((percent <= 20) && (percent >= 11))
-        {
-            makeTurn(RIGHT_BOTH_MOTOR,180000);
-        } 
-        // hard right
-        else if ((percent <= 10) && (percent >= 0))
-        {
-            makeTurn(RIGHT_BOTH_MOTOR,260000);
-        }                       
+            rate = -LIGHT_TURN_HARD_US;
+        }
+
+        estimate.rate = (alt_32)rate;
+    }
+
+    estimate.updated = now;
+    estimate.valid   = TRUE;
+}
+
+
+/****************************************************************
+* Function name     : steerOnEstimate
+*    returns        : TRUE (1) if a turn was made
+*    arg1           : void
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Predicts the light bearing to now and turns
+*                     towards it, by the same bands the raw cone
+*                     middle used to be turned by
+* Notes             : Nothing to turn on once the estimate is
+*                     older than LIGHT_BEARING_FORGET_US
+****************************************************************/
+alt_u8 steerOnEstimate(void)
+{
+    alt_u32 age, ms;
+    alt_32 relative;
+    float percent;
+
+    if (!estimate.valid)
+    {
+        return FALSE;
+    }
+
+    age = recorderValue(controlTicks()) - estimate.updated;
+
+    if (age > LIGHT_BEARING_FORGET_TICKS)
+    {
+        estimate.valid = FALSE;
+        return FALSE;
+    }
+
+    ms = (age * CONTROL_TICK_US) / 1000;
+
+    /* a turn still being steered is as good as made */
+    relative = estimate.bearing + (alt_32)(((alt_64)estimate.rate * ms) / 1000) -
+               (estimate.heading + estimate.arc);
+
+    /* where it is across the eye's sweep, 100 at the left switch */
+    percent = 50 + (((float)relative / (float)LIGHT_TURN_HARD_US) * 50);
+
+    if (percent > 100)
+    {
+        percent = 100;
+    }
+    else if (percent < 0)
+    {
+        percent = 0;
+    }
+
+    /* determines how much to turn depending on where the light is */
+    // hard left 
+    if ((percent <= 100) && (percent >= 90))
+    {
+        makeTurn(LEFT_BOTH_MOTOR,LIGHT_TURN_HARD_US);
+    } 
+    else if ((percent <= 91) && (percent >= 80))
+    {
+        makeTurn(LEFT_BOTH_MOTOR,LIGHT_TURN_WIDE_US);
+    } 
+    else if ((percent <= 81) && (percent >= 56))
+    {
+        makeTurn(LEFT_BOTH_MOTOR,LIGHT_TURN_MEDIUM_US);
+    } 
+    // soft left
+    else if ((percent <= 55) && (percent >= 50))
+    {
+        makeTurn(LEFT_BOTH_MOTOR,LIGHT_TURN_SOFT_US);
+    }
+    // soft right
+    else if ((percent <= 40) && (percent >= 35))
+    {
+        makeTurn(RIGHT_BOTH_MOTOR,LIGHT_TURN_SOFT_US);
+    } 
+    else if ((percent <= 34) && (percent >= 21))
+    {
+        makeTurn(RIGHT_BOTH_MOTOR,LIGHT_TURN_MEDIUM_US);
+    } 
+    else if ((percent <= 20) && (percent >= 11))
+    {
+        makeTurn(RIGHT_BOTH_MOTOR,LIGHT_TURN_WIDE_US);
+    } 
+    // hard right
+    else if ((percent <= 10) && (percent >= 0))
+    {
+        makeTurn(RIGHT_BOTH_MOTOR,LIGHT_TURN_HARD_US);
+    }
+    else
+    {
+        return FALSE;
     }
+
+    return TRUE;
 }
 
 
+/****************************************************************
+* Function name     : driveStep
+*    returns        : void
+*    arg1           : void
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Forward part of a scan step. While a turn is
+*                     left to steer the step is driven on a curve
+*                     and the heading moves on by what it turned,
+*                     the last step of a turn on a gentler curve so
+*                     it does not go past.
+* Notes             : A curve turns at curve / (2 x
+*                     CONTROL_CURVE_FULL) of pivot speed, so a step
+*                     needs LIGHT_DRIVE_US of 2 x CONTROL_CURVE_FULL
+*                     to turn at all
+****************************************************************/
+void driveStep(void)
+{
+    alt_32 curve, turned, left;
+
+    left = (estimate.arc < 0) ? -estimate.arc : estimate.arc;
+
+    /* curve that would just finish the turn this step */
+    curve = (LIGHT_DRIVE_US > 0) ? (left * 2 * CONTROL_CURVE_FULL) / LIGHT_DRIVE_US : LIGHT_ARC_CURVE;
+
+    if (curve > LIGHT_ARC_CURVE)
+    {
+        curve = LIGHT_ARC_CURVE;
+    }
 
+    turned = (LIGHT_DRIVE_US * curve) / (2 * CONTROL_CURVE_FULL);
 
+    /* less left than a step can turn, count it done or the arc
+     * would never be used up */
+    if (turned == 0)
+    {
+        turned = left;
+    }
 
+    if (estimate.arc < 0)
+    {
+        curve  = -curve;
+        turned = -turned;
+    }
+
+    controlSteer(curve, CONTROL_DUTY_FULL);
 
+    usleep(controlMotionUs(LIGHT_DRIVE_US, CONTROL_DUTY_FULL));
+
+    estimate.heading += turned;
+    estimate.arc     -= turned;
+}
@@ -26,6 +26,17 @@
 *    Move Smoothly
 *
 *    Stop at an obstruction
+*
+*    Tell straights, gentle curves and sharp corners apart from
+*    the timing of recent floor sensor changes, running flat out
+*    on straights and slowing into corners before overshooting
+*
+*    Learn a closed course on the first lap and drive the laps
+*    after it from the map, flat out down the known straights and
+*    slowing just before the known corners
+*
+* Sensing, motor PWM and stopping at an obstruction run in the
+* Control inner loop, this module is the behaviour on top.
 * 
 *****************************************************************
 *  Includes section
@@ -36,10 +47,21 @@ To hardware addresses etc. */
 #include "system.h"
 #include "altera_avalon_pio_regs.h"
 #include "alt_types.h"
+#include "sys/alt_timestamp.h"
 
 #include <unistd.h>        
 #include <stdio.h>
 
+#include "Control.h"
+#include "EventQueue.h"
+#include "Telemetry.h"
+#include "Recorder.h"
+
+/* Tuned timings generated by host/autotune, see the Tuning section */
+#ifdef USE_TUNED_PARAMS
+#include "TunedParams.h"
+#endif
+
 /*****************************************************************
 *  Defines section
 *****************************************************************/
@@ -51,6 +73,13 @@ To hardware addresses etc. */
 #define RIGHT_ONE_MOTOR  0x5
 #define LEFT_BOTH_MOTOR  0xB
 #define RIGHT_BOTH_MOTOR 0x7
+#define BACKWARD         0x3
+
+/* Motor nibble bits, per wheel an enable and a forward bit */
+#define MOTOR_LEFT_ON       0x1
+#define MOTOR_RIGHT_ON      0x2
+#define MOTOR_LEFT_FORWARD  0x4
+#define MOTOR_RIGHT_FORWARD 0x8
 
 /* Sensors */
 #define LEFT_FLOOR_SENSOR  0x4000
@@ -58,83 +87,373 @@ To hardware addresses etc. */
 #define LEFT_FRONT_BUMPER  0x8000
 #define RIGHT_FRONT_BUMPER 0x800
 
+#define FRONT_BUMPERS (LEFT_FRONT_BUMPER | RIGHT_FRONT_BUMPER)
+
+/* Header bits worth sending in telemetry */
+#define SENSOR_MASK (LEFT_FLOOR_SENSOR | RIGHT_FLOOR_SENSOR | LEFT_FRONT_BUMPER | RIGHT_FRONT_BUMPER)
+
+/* Tuning - defaults are the values found by hand on the track,
+ * defining USE_TUNED_PARAMS takes them from TunedParams.h instead */
+#ifndef LINE_DRIVE_US
+#define LINE_DRIVE_US        500    /* motors on each loop */
+#endif
+#ifndef LINE_TURN_STOP_US
+#define LINE_TURN_STOP_US    100    /* motors off after a turn */
+#endif
+#ifndef LINE_FORWARD_STOP_US
+#define LINE_FORWARD_STOP_US 30     /* motors off after going forward */
+#endif
+#ifndef LINE_LOST_REPEATS
+#define LINE_LOST_REPEATS    5000   /* loops without the line before spiral() */
+#endif
+#ifndef LINE_SHARP_US
+#define LINE_SHARP_US        40000  /* one correction held this long is a corner */
+#endif
+#ifndef LINE_CORNER_STOP_US
+#define LINE_CORNER_STOP_US  200    /* motors off after a turn in a corner */
+#endif
+#ifndef LINE_ARC_CURVE
+#define LINE_ARC_CURVE       0      /* curve corrections are steered on, 0 pivots them */
+#endif
+#ifndef LINE_BYPASS_SIDE
+#define LINE_BYPASS_SIDE     BYPASS_LEFT  /* side to go round obstacles */
+#endif
+#ifndef LINE_BYPASS_WAIT_US
+#define LINE_BYPASS_WAIT_US  500000 /* wait for it to move before going round */
+#endif
+#ifndef LINE_BYPASS_REVERSE_US
+#define LINE_BYPASS_REVERSE_US 400000 /* back off before turning out */
+#endif
+#ifndef LINE_BYPASS_TURN_US
+#define LINE_BYPASS_TURN_US  320000 /* pivot a right angle */
+#endif
+#ifndef LINE_BYPASS_OUT_US
+#define LINE_BYPASS_OUT_US   800000 /* out to the side far enough to clear it */
+#endif
+#ifndef LINE_BYPASS_PAST_US
+#define LINE_BYPASS_PAST_US  1800000 /* alongside until past it */
+#endif
+#ifndef LINE_BYPASS_SEEK_US
+#define LINE_BYPASS_SEEK_US  2000000 /* back in before giving up on the line */
+#endif
+#ifndef LINE_MAP
+#define LINE_MAP             1      /* learn the course on the first lap, 0 never does */
+#endif
+#ifndef LINE_MAP_CORNER_US
+#define LINE_MAP_CORNER_US   100000 /* turned over two map steps that makes a corner */
+#endif
+#ifndef LINE_MAP_CURVE_US
+#define LINE_MAP_CURVE_US    60000  /* turned in one map step that makes a curve */
+#endif
+#ifndef LINE_MAP_BRAKE_STEPS
+#define LINE_MAP_BRAKE_STEPS 2      /* map steps before a known corner to slow down */
+#endif
+#ifndef LINE_MAP_BRAKE_US
+#define LINE_MAP_BRAKE_US    30     /* motors off each loop slowing for a corner */
+#endif
+#ifndef LINE_MAP_MATCH_STEPS
+#define LINE_MAP_MATCH_STEPS 8      /* how far from the map a corner still counts as it */
+#endif
+
+/* Obstacle bypass sides, BYPASS_OFF waits for it to be moved */
+#define BYPASS_OFF   0
+#define BYPASS_LEFT  1
+#define BYPASS_RIGHT 2
+
+/* How often a bypass leg checks the sensors */
+#define BYPASS_POLL_US 1000
+
+/* Coming back from the left the tape is crossed so edgeSensor()
+ * finds the right hand edge, enough for a 45 degree crossing */
+#define BYPASS_CROSS_US 200000
+
+/* How a bypass leg ended */
+#define LEG_DONE    0
+#define LEG_FOUND   1   /* one of the until bits went active */
+#define LEG_BLOCKED 2   /* a bumper went active going forward */
+
+/* Track shape, worked out from the floor sensor history */
+#define TRACK_STRAIGHT 0
+#define TRACK_GENTLE   1
+#define TRACK_SHARP    2
+
+/* Floor sensor changes remembered, must be a power of 2 */
+#define HISTORY_SIZE 8
+#define HISTORY_MASK (HISTORY_SIZE - 1)
+
+/* Floor bits as read, sensors pull their bit low over the line */
+#define FLOOR_BITS     (LEFT_FLOOR_SENSOR | RIGHT_FLOOR_SENSOR)
+#define FLOOR_ON_EDGE  RIGHT_FLOOR_SENSOR   /* left on line, right off */
+#define FLOOR_LOST     FLOOR_BITS           /* neither on the line */
+
+/* Course map. Distance is microseconds of driving at full duty,
+ * worked out from the motor commands, and turns are microseconds
+ * of a full duty pivot, around 314000 for a right angle. The course
+ * is recorded a MAP_STEP_US step at a time, each step typed by how
+ * far it turned, and steps of the same type run together into a
+ * MapSegment */
+#define MAP_STEP_US      80000   /* about 20mm */
+#define MAP_SEGMENTS     64
+#define MAP_CORNERS      32      /* corners remembered while learning,
+                                  * two laps of them */
+#define MAP_STEPS        1024    /* longest course, about 20m */
+#define MAP_MATCH        3       /* corners in a row that place the robot on the map */
+#define MAP_CORNER_GAP   3       /* steps after a corner before the next can start */
+#define MAP_LOST_MISSES  2       /* corners not on the map before looking again */
+
+/* Map states */
+#define MAP_OFF      0    /* not learning, or the course did not fit */
+#define MAP_LEARNING 1    /* first lap, recording */
+#define MAP_KNOWN    2    /* driving from the map */
+#define MAP_LOCATING 3    /* map known but lost the place on it */
+
+/* What the map says to do at each step of the lap */
+#define PROFILE_REACTIVE 0    /* leave it to the floor sensors */
+#define PROFILE_FULL     1    /* known straight, full duty */
+#define PROFILE_BRAKE    2    /* a known corner is close */
+
+/* Telemetry */
+#define TELEMETRY_EVERY 4    /* one record per 4 loops keeps inside the UART rate */
+#define STATE_FOLLOWING 0
+#define STATE_LOST      1
+#define STATE_SPIRAL    2
+#define STATE_CORNER    3
+#define STATE_BYPASS    4
+
+/*****************************************************************
+*  Types section
+*****************************************************************/
+
+typedef struct
+{
+    alt_u32 when[HISTORY_SIZE];   /* alt_timestamp() of each change */
+    alt_u32 floor[HISTORY_SIZE];  /* floor bits just after it       */
+    alt_u32 count;                /* changes seen, masked on use    */
+    alt_u32 ticksPerUs;
+} FloorHistory;
+
+/* A run of map steps of one type */
+typedef struct
+{
+    alt_u16 start;     /* step it starts at, from when learning started */
+    alt_u16 length;    /* steps */
+    alt_u8  type;      /* TRACK_STRAIGHT, TRACK_GENTLE or TRACK_SHARP */
+    alt_8   turn;      /* 1 left, -1 right, 0 straight */
+} MapSegment;
+
+/* A corner as it was driven, step counted from when learning started */
+typedef struct
+{
+    alt_u32 step;
+    alt_8   turn;
+} MapCorner;
+
+typedef struct
+{
+    alt_u8  state;                  /* MAP_OFF, _LEARNING, _KNOWN or _LOCATING */
+
+    /* odometry */
+    alt_32  stepDistance;           /* driven us into the current step */
+    alt_32  stepTurn;               /* pivot us turned in the current step */
+    alt_32  lastTurn;               /* and in the one before */
+    alt_u32 step;                   /* steps completed since learning started */
+    alt_u32 lastCorner;             /* step the last corner started at */
+    alt_u8  pending;                /* type of the step before, not yet added */
+
+    /* the course */
+    MapSegment segment[MAP_SEGMENTS];
+    alt_u8  segments;
+    MapCorner corner[MAP_CORNERS];  /* while learning, every one, after it
+                                     * the ones in the lap */
+    alt_u8  corners;
+    alt_u8  repeat;                 /* corner the first one came round
+                                     * again at while learning, 0 none */
+    alt_u16 lapSteps;
+    alt_u8  profile[MAP_STEPS];     /* PROFILE_ for each step of the lap */
+
+    /* where the robot is on it */
+    alt_u32 lapStart;               /* step the current lap began at */
+    MapCorner seen[MAP_MATCH];      /* last corners driven, newest last */
+    alt_u8  misses;
+} TrackMap;
+
 /*****************************************************************
 *  Function Prototype Section
 *****************************************************************/
 
 int main (void) __attribute__ ((weak, alias ("alt_main")));
 
-alt_u32 edgeSensor(alt_u32 *repeats);
+alt_u32 edgeSensor(alt_u32 *repeats, alt_u32 *header);
 
 void spiral(void);
 
 void checkObstruction(void);
 
+void bypassObstacle(void);
+
+alt_u8 bypassLeg(alt_u32 motors, alt_u32 us, alt_u32 until);
+
+void updateHistory(FloorHistory *history, EventQueue *queue);
+
+alt_u8 classifyTrack(const FloorHistory *history, alt_u32 now, alt_u32 *bias);
+
+void mapStart(TrackMap *map);
+
+void mapDrive(TrackMap *map, alt_u32 output, int curve, alt_u32 onUs);
+
+void mapStep(TrackMap *map);
+
+void mapAdd(TrackMap *map, alt_u8 type, alt_8 turn);
+
+void mapCorner(TrackMap *map, alt_u32 step, alt_8 turn);
+
+alt_u8 mapMatch(const TrackMap *map, alt_u8 first);
+
+void mapClose(TrackMap *map);
+
+alt_u32 mapPosition(const TrackMap *map, alt_u32 step);
+
+alt_u8 mapProfile(const TrackMap *map);
+
+void mapLost(TrackMap *map);
+
+/*****************************************************************
+*  Global Variables Section
+*****************************************************************/
+
+/* Floor sensor edges, posted by the header interrupt */
+EventQueue floorEvents;
+
+/* What has been learnt of the course */
+TrackMap courseMap;
+
 /****************************************************************/
 
 alt_main()
 {
     /* 32 bit unsigned variable to allow us to interact with 
      * the Marco hardware */
-    alt_u32 output, noLineRepeats;
+    alt_u32 output, noLineRepeats, header, bias, offUs;
+
+    alt_u8 track, profile;
+
+    FloorHistory history;
     
     /* This sets the direction for bits on the expansion header.
     A â€˜1â€™ means itâ€™s writable â€˜0â€™ readable. */
     IOWR_ALTERA_AVALON_PIO_DIRECTION(EXPANSION_JP1_BASE,0xF000000F);
   
-    /* initialise outputs to blank */
-    output = 0x0;
-    /* pass initialised inputs to header */
-    IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,output);
+    /* inner loop takes over the header, stopping for the bumpers */
+    controlStart(FRONT_BUMPERS, CONTROL_NO_ADC);
     
     noLineRepeats = 0;
+
+    telemetryInit(TELEMETRY_EVERY, SENSOR_MASK);
+
+    /* time every change of the floor sensors from here on */
+    history.count = 0;
+    history.ticksPerUs = alt_timestamp_freq() / 1000000;
+    jp1EventsStart(&floorEvents, FLOOR_BITS);
+
+    /* learn the course from here */
+    mapStart(&courseMap);
     
     /* main loop */
     while(1)
     {
         
         /* call edgeSensor function to assign a value to output*/
-        output = edgeSensor(&noLineRepeats);
+        output = edgeSensor(&noLineRepeats, &header);
+
+        /* see what the track has been doing since the last loop */
+        updateHistory(&history, &floorEvents);
+
+        track = classifyTrack(&history, recorderValue(alt_timestamp()), &bias);
+
+        /* what the map says about where the robot is */
+        profile = mapProfile(&courseMap);
+
+        /* coming out of a corner keep turning into it rather than
+         * running straight on across the far side of the line */
+        if ((track == TRACK_SHARP) && (output == FOWARD))
+        {
+            output = bias;
+        }
+
+        /* queue a telemetry record, never waits for the UART */
+        telemetryRecord(header & SENSOR_MASK, output, TELEMETRY_NO_STEPPER, 0,
+                        (noLineRepeats != 0) ? STATE_LOST :
+                        (track == TRACK_SHARP) ? STATE_CORNER : STATE_FOLLOWING);
         
         /* if no line has been detected for a time equivalent to a single rotation
          * call spiral function to spin untill line is found again */
-        if (noLineRepeats == 5000)
+        if (noLineRepeats >= LINE_LOST_REPEATS)
         {
 
             spiral();
 
             noLineRepeats = 0;
+
+            /* no telling where on the course it came back */
+            mapLost(&courseMap);
             
         }
-                           
-        /* Apply output variable to header to control motors on, left, 
-         * right, foward or backwards*/         
-        IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,output);
-        
-        usleep(500);
-        
-        /* if output is not foward wait for a longer period to allow for 
-         * smoother corner turning*/ 
+
+        /* if output is not foward the motors are off for longer to allow 
+         * for smoother corner turning, longer again once in a corner*/ 
         if(!(output==0xF))
         {
-            output = STOP;
-        
-            IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,output);
-        
-            usleep(100);    
-   
+            offUs = (track == TRACK_SHARP) ? LINE_CORNER_STOP_US : LINE_TURN_STOP_US;
         }
 
-        /* default time motor is off for smoothness control */
+        /* default time motor is off for smoothness control, straights
+         * run at full duty without it */
+        else if (track != TRACK_STRAIGHT)
+        {
+            offUs = LINE_FORWARD_STOP_US;
+        }
         else
         {
-            output = STOP;
-        
-            IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,output);
-        
-            usleep(30);   
+            offUs = 0;
         }
 
+        /* on a known straight even the corrections are at full duty,
+         * close to a known corner it slows down before the sensors
+         * have seen any sign of it. A corner the sensors have seen
+         * is always taken slow, the map can be a few steps out */
+        if ((profile == PROFILE_FULL) && (track != TRACK_SHARP))
+        {
+            offUs = 0;
+        }
+        else if ((profile == PROFILE_BRAKE) && (offUs < LINE_MAP_BRAKE_US))
+        {
+            offUs = LINE_MAP_BRAKE_US;
+        }
+
+        /* Apply output to the motors on, left, right, foward or 
+         * backwards. The inner loop turns on then off into a duty.
+         * With LINE_ARC_CURVE set, a correction away from a corner
+         * is steered on a curve instead of pivoting. Off by default,
+         * at this loop rate pivots and forward already blend into a
+         * curve and come out quicker round the course */
+        if ((LINE_ARC_CURVE != 0) && (track != TRACK_SHARP) &&
+            ((output == LEFT_BOTH_MOTOR) || (output == RIGHT_BOTH_MOTOR)))
+        {
+            controlSteer((output == LEFT_BOTH_MOTOR) ? LINE_ARC_CURVE : -LINE_ARC_CURVE,
+                         CONTROL_DUTY_OF(LINE_DRIVE_US, offUs));
+
+            mapDrive(&courseMap, output, (output == LEFT_BOTH_MOTOR) ? LINE_ARC_CURVE : -LINE_ARC_CURVE,
+                     LINE_DRIVE_US);
+        }
+        else
+        {
+            controlSetMotors(output, CONTROL_DUTY_OF(LINE_DRIVE_US, offUs));
+
+            mapDrive(&courseMap, output, 0, LINE_DRIVE_US);
+        }
+        
+        usleep(LINE_DRIVE_US + offUs);
+
         checkObstruction();
   
     }
@@ -150,6 +469,8 @@ alt_main()
 *                     called and no line was detected. passed by 
 *                     reference so its value is maintained
 *                     between calls
+*    arg2           : header value read from the robot, passed
+*                     back out for telemetry
 * Created by        : Connor Parker
 * Date created      : 02/02/17
 * Description       : This is the main function to determine
@@ -160,14 +481,16 @@ alt_main()
 * Notes             : n/a                     
 *                     
 ****************************************************************/
-alt_u32 edgeSensor(alt_u32 *noLineRepeats)
+alt_u32 edgeSensor(alt_u32 *noLineRepeats, alt_u32 *headerOut)
 {
 
     /* 32 bit unsigned variable to read value of header into*/
     alt_u32 header, direction;
 
-    /* read value of header into header variable*/        
-    header = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+    /* read debounced header from the inner loop into header variable*/        
+    header = controlInputs();
+
+    *headerOut = header;
      
     /* initialise return value to stop in case of error */      
     direction = STOP;
@@ -259,27 +582,23 @@ void spiral()
         /* both motors going foward for varWait which increases over time*/        
         output = 0xF;     
 
-        IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,output);
+        controlSetMotors(output, CONTROL_DUTY_FULL);
         
         /* usleep with a variable which icreases every 20 loops */
         usleep(varWait);
 
-        /* only left motor on  to produce circling motion*/  
+        /* only left motor on  to produce circling motion, with the
+         * motors off for a little of it for speed control*/  
         output = 0xD;     
 
-        IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,output);
-        
-        usleep(500);
-        
-        /* both motors off for speed control*/
-        output = STOP;
-        
-        IOWR_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE,output);
+        controlSetMotors(output, CONTROL_DUTY_OF(500, 30));
         
-        usleep(30); 
+        usleep(530);
 
         /* read header to determine state of sensors */
-        header = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+        header = controlInputs();
+
+        telemetryRecord(header & SENSOR_MASK, 0xD, TELEMETRY_NO_STEPPER, 0, STATE_SPIRAL);
 
         /* if either sensor has detected line exit loop */
         if (((header & LEFT_FLOOR_SENSOR) != 16384) || ((header & RIGHT_FLOOR_SENSOR) != 8192))
@@ -302,38 +621,861 @@ void spiral()
 * Description       : Checks for objects activaing the sensors on
 *                     the front of the bot. If an obstruction is 
 *                     found movement will be stopped untill the
-*                     it is removed                     
-* Notes             : n/a
+*                     it is removed, or if it is still there after
+*                     LINE_BYPASS_WAIT_US the bot goes round it
+* Notes             : LINE_BYPASS_SIDE BYPASS_OFF always waits
 ****************************************************************/
 void checkObstruction()
 { 
-    alt_u32 header;
+    alt_u32 header, waited;
 
     alt_u8 blocked;
 
-    /* read value of header into header variable*/        
-    header = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);
+    /* read value of header into header variable, the inner loop
+     * has already stopped the motors if a bumper is pressed*/        
+    header = controlInputs();
 
     /* if either front sensor detects a blockage enter if*/
-    if (((header & LEFT_FRONT_BUMPER ) != 32768) || ((RIGHT_FRONT_BUMPER & 0x800) != 2048))
+    if (((header & LEFT_FRONT_BUMPER ) != 32768) || ((header & RIGHT_FRONT_BUMPER) != 2048))
     {
         blocked = 1;
+        waited  = 0;
+
+        /* stay still until it is removed */
+        controlSetMotors(STOP, 0);
 
         while(blocked == 1)
         {
 
             /* read value of header into header variable*/        
-            header = IORD_ALTERA_AVALON_PIO_DATA(EXPANSION_JP1_BASE);        
+            header = controlInputs();        
 
-            if (((header & LEFT_FRONT_BUMPER ) == 32768) && ((RIGHT_FRONT_BUMPER & 0x800) == 2048))   
+            if (((header & LEFT_FRONT_BUMPER ) == 32768) && ((header & RIGHT_FRONT_BUMPER) == 2048))   
             {
                 blocked = 0;
             }
 
+            /* not going to move, go round it */
+            else if ((LINE_BYPASS_SIDE != BYPASS_OFF) && (waited >= LINE_BYPASS_WAIT_US))
+            {
+                bypassObstacle();
+
+                /* the way round is not part of the course */
+                mapLost(&courseMap);
+
+                blocked = 0;
+            }
+
             usleep(500);
 
+            waited += 500;
+
+        }
+    }
+}
+
+/****************************************************************
+* Function name     : bypassObstacle
+*    returns        : void
+*    arg1           : void
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Backs off and drives round the obstacle in
+*                     three straight sides on LINE_BYPASS_SIDE,
+*                     then heads back in at 45 degrees to the
+*                     line's old path until a floor sensor finds
+*                     it. The shallow angle leaves edgeSensor() a
+*                     normal corner to take from there.
+* Notes             : Hitting something else on the way round
+*                     gives up and leaves it to the next
+*                     checkObstruction(). Not finding the line
+*                     leaves it to the lost count and spiral().
+****************************************************************/
+void bypassObstacle()
+{
+    alt_u32 away, back;
+
+    alt_u8 result;
+
+    if (LINE_BYPASS_SIDE == BYPASS_LEFT)
+    {
+        away = LEFT_BOTH_MOTOR;
+        back = RIGHT_BOTH_MOTOR;
+    }
+    else
+    {
+        away = RIGHT_BOTH_MOTOR;
+        back = LEFT_BOTH_MOTOR;
+    }
+
+    /* back off and turn out to the side */
+    bypassLeg(BACKWARD, LINE_BYPASS_REVERSE_US, 0);
+    bypassLeg(away, LINE_BYPASS_TURN_US, 0);
+
+    if (bypassLeg(FOWARD, LINE_BYPASS_OUT_US, FRONT_BUMPERS) == LEG_BLOCKED)
+    {
+        return;
+    }
+
+    /* straighten up and go along beside it */
+    bypassLeg(back, LINE_BYPASS_TURN_US, 0);
+
+    if (bypassLeg(FOWARD, LINE_BYPASS_PAST_US, FRONT_BUMPERS) == LEG_BLOCKED)
+    {
+        return;
+    }
+
+    /* head back in, the line is across the way */
+    bypassLeg(back, LINE_BYPASS_TURN_US / 2, 0);
+
+    result = bypassLeg(FOWARD, LINE_BYPASS_SEEK_US, FLOOR_BITS | FRONT_BUMPERS);
+
+    if ((result == LEG_FOUND) && (LINE_BYPASS_SIDE == BYPASS_LEFT))
+    {
+        bypassLeg(FOWARD, BYPASS_CROSS_US, FRONT_BUMPERS);
+    }
+
+    controlSetMotors(STOP, 0);
+}
+
+/****************************************************************
+* Function name     : bypassLeg
+*    returns        : LEG_DONE, LEG_FOUND or LEG_BLOCKED
+*    arg1           : motors - motor nibble for the leg
+*    arg2           : us - length of the leg at nominal battery
+*    arg3           : until - active low header bits that end
+*                     the leg early, 0 for none
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : One timed part of a bypass, checking the
+*                     header every BYPASS_POLL_US
+* Notes             : Length is stretched for a low battery, see
+*                     controlMotionUs()
+****************************************************************/
+alt_u8 bypassLeg(alt_u32 motors, alt_u32 us, alt_u32 until)
+{
+    alt_u32 header, polls;
+
+    controlSetMotors(motors, CONTROL_DUTY_FULL);
+
+    for (polls = controlMotionUs(us, CONTROL_DUTY_FULL) / BYPASS_POLL_US; polls > 0; polls--)
+    {
+        usleep(BYPASS_POLL_US);
+
+        header = controlInputs();
+
+        telemetryRecord(header & SENSOR_MASK, motors, TELEMETRY_NO_STEPPER, 0, STATE_BYPASS);
+
+        if ((header & until & FRONT_BUMPERS) != (until & FRONT_BUMPERS))
+        {
+            return LEG_BLOCKED;
+        }
+
+        if ((header & until) != until)
+        {
+            return LEG_FOUND;
+        }
+    }
+
+    return LEG_DONE;
+}
+
+/****************************************************************
+* Function name     : updateHistory
+*    returns        : void
+*    arg1           : history - record of floor sensor changes
+*    arg2           : queue - events posted by the header ISR
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Moves every waiting floor sensor event into
+*                     the history, oldest first, keeping only the
+*                     ones that really changed the floor bits
+* Notes             : The history keeps the last HISTORY_SIZE
+*                     changes, older ones are overwritten
+****************************************************************/
+void updateHistory(FloorHistory *history, EventQueue *queue)
+{
+    SensorEvent event;
+
+    alt_u32 floor, last;
+
+    while (eventQueueTake(queue, &event))
+    {
+        floor = event.header & FLOOR_BITS;
+
+        /* an edge that bounced back before the ISR read it */
+        if (history->count > 0)
+        {
+            last = (history->count - 1) & HISTORY_MASK;
+
+            if (history->floor[last] == floor)
+            {
+                continue;
+            }
+        }
+
+        history->when[history->count & HISTORY_MASK]  = event.timestamp;
+        history->floor[history->count & HISTORY_MASK] = floor;
+        history->count++;
+    }
+}
+
+/****************************************************************
+* Function name     : classifyTrack
+*    returns        : TRACK_STRAIGHT, TRACK_GENTLE or TRACK_SHARP
+*    arg1           : history - record of floor sensor changes
+*    arg2           : now - alt_timestamp() to measure up to
+*    arg3           : bias - set to the one motor turn towards a
+*                     corner when TRACK_SHARP is returned
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Following the right edge of the line the
+*                     robot weaves, correcting right when both
+*                     sensors see the line and left when neither
+*                     does.
+*
+*                     On a straight the two corrections come
+*                     rarely and about equally. A curve shows
+*                     as more time correcting one way. A corner
+*                     shows as one correction lasting longer than
+*                     LINE_SHARP_US, and the robot counts as still
+*                     in it until it has been back on the edge for
+*                     as long again.
+* Notes             : With too little history to go on the track
+*                     is taken to be a gentle curve, the old
+*                     behaviour
+****************************************************************/
+alt_u8 classifyTrack(const FloorHistory *history, alt_u32 now, alt_u32 *bias)
+{
+    alt_u32 i, n, newest, index, next, held, lastHeld, sharpTicks;
+
+    alt_u32 leftTime, rightTime, span;
+
+    if (history->count < 2)
+    {
+        return TRACK_GENTLE;
+    }
+
+    sharpTicks = LINE_SHARP_US * history->ticksPerUs;
+
+    newest = (history->count - 1) & HISTORY_MASK;
+    index  = (history->count - 2) & HISTORY_MASK;
+
+    held     = now - history->when[newest];
+    lastHeld = history->when[newest] - history->when[index];
+
+    /* stuck in one correction, a corner */
+    if ((history->floor[newest] != FLOOR_ON_EDGE) && (held > sharpTicks))
+    {
+        *bias = (history->floor[newest] == FLOOR_LOST) ? LEFT_ONE_MOTOR : RIGHT_ONE_MOTOR;
+
+        return TRACK_SHARP;
+    }
+
+    /* just come out of one, still on the way round it */
+    if ((history->floor[newest] == FLOOR_ON_EDGE) && (history->floor[index] != FLOOR_ON_EDGE) &&
+        (lastHeld > sharpTicks) && (held < lastHeld))
+    {
+        *bias = (history->floor[index] == FLOOR_LOST) ? LEFT_ONE_MOTOR : RIGHT_ONE_MOTOR;
+
+        return TRACK_SHARP;
+    }
+
+    /* add up time spent correcting each way over the history */
+    n = (history->count < HISTORY_SIZE) ? history->count : HISTORY_SIZE;
+
+    leftTime  = 0;
+    rightTime = 0;
+
+    for (i = history->count - n; i < history->count - 1; i++)
+    {
+        index = i & HISTORY_MASK;
+        next  = (i + 1) & HISTORY_MASK;
+
+        if (history->floor[index] == FLOOR_LOST)
+        {
+            leftTime += history->when[next] - history->when[index];
+        }
+        else if (history->floor[index] != FLOOR_ON_EDGE)
+        {
+            rightTime += history->when[next] - history->when[index];
+        }
+    }
+
+    /* include the state the robot is in now */
+    if (history->floor[newest] == FLOOR_LOST)
+    {
+        leftTime += held;
+    }
+    else if (history->floor[newest] != FLOOR_ON_EDGE)
+    {
+        rightTime += held;
+    }
+
+    span = now - history->when[(history->count - n) & HISTORY_MASK];
+
+    /* correcting for a quarter of the time, or an eighth mostly one
+     * way, is a curve */
+    if (((leftTime + rightTime) > span / 4) ||
+        (((leftTime + rightTime) > span / 8) && ((leftTime > 2 * rightTime) || (rightTime > 2 * leftTime))))
+    {
+        return TRACK_GENTLE;
+    }
+
+    return TRACK_STRAIGHT;
+}
+
+/****************************************************************
+* Function name     : mapStart
+*    returns        : void
+*    arg1           : map - course map to set up
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Forgets any course and starts learning it
+*                     from where the robot is now, which becomes
+*                     step 0 of the lap
+* Notes             : LINE_MAP 0 leaves the map off for good
+****************************************************************/
+void mapStart(TrackMap *map)
+{
+    map->state        = LINE_MAP ? MAP_LEARNING : MAP_OFF;
+    map->stepDistance = 0;
+    map->stepTurn     = 0;
+    map->lastTurn     = 0;
+    map->step         = 0;
+    map->lastCorner   = 0;
+    map->pending      = TRACK_STRAIGHT;
+    map->segments     = 0;
+    map->corners      = 0;
+    map->repeat       = 0;
+    map->lapSteps     = 0;
+    map->lapStart     = 0;
+    map->misses       = 0;
+}
+
+/****************************************************************
+* Function name     : mapDrive
+*    returns        : void
+*    arg1           : map - course map
+*    arg2           : output - motor nibble just set
+*    arg3           : curve - controlSteer() curve it was steered
+*                     on instead, 0 if it was not
+*    arg4           : onUs - time the motors are on for
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Odometry from the motor commands. What the
+*                     wheels drive together is the distance and
+*                     what they drive apart is the turn. Every
+*                     MAP_STEP_US of distance is one step of the
+*                     map.
+* Notes             : Worked out from what the module commands,
+*                     not Control's counts, so it needs nothing in
+*                     the recording and replays the same. Off ticks
+*                     of the duty are not counted, so neither is
+*                     the robot coasting.
+****************************************************************/
+void mapDrive(TrackMap *map, alt_u32 output, int curve, alt_u32 onUs)
+{
+    alt_32 left, right;
+
+    if (map->state == MAP_OFF)
+    {
+        return;
+    }
+
+    if (curve != 0)
+    {
+        /* outside wheel on full, inside wheel slowed by the curve */
+        left  = onUs;
+        right = onUs;
+
+        if (curve > 0)
+        {
+            left = (onUs * (CONTROL_CURVE_FULL - curve)) / CONTROL_CURVE_FULL;
+        }
+        else
+        {
+            right = (onUs * (CONTROL_CURVE_FULL + curve)) / CONTROL_CURVE_FULL;
+        }
+    }
+    else
+    {
+        left  = (output & MOTOR_LEFT_ON) ? ((output & MOTOR_LEFT_FORWARD) ? onUs : -(alt_32)onUs) : 0;
+        right = (output & MOTOR_RIGHT_ON) ? ((output & MOTOR_RIGHT_FORWARD) ? onUs : -(alt_32)onUs) : 0;
+    }
+
+    /* half the difference is the time each wheel pivoted */
+    map->stepTurn     += (right - left) / 2;
+    map->stepDistance += (left + right) / 2;
+
+    while (map->stepDistance >= MAP_STEP_US)
+    {
+        mapStep(map);
+
+        map->stepDistance -= MAP_STEP_US;
+    }
+}
+
+/****************************************************************
+* Function name     : mapStep
+*    returns        : void
+*    arg1           : map - course map
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Types the step just finished. Two steps that
+*                     turn LINE_MAP_CORNER_US between them are a
+*                     corner, a square corner is mostly pivoted so
+*                     it hardly moves the robot on. A step turning
+*                     LINE_MAP_CURVE_US is a curve. As a corner is
+*                     only seen at its second step, each step is
+*                     added to the map one step late.
+* Notes             : Steps are only added while learning, corners
+*                     are passed on in every state
+****************************************************************/
+void mapStep(TrackMap *map)
+{
+    alt_32 pair;
+
+    alt_8 turn;
+
+    alt_u8 type;
+
+    pair = map->lastTurn + map->stepTurn;
+
+    turn = (pair > 0) ? 1 : -1;
+
+    if ((map->step > 0) &&
+        ((pair >= LINE_MAP_CORNER_US) || (pair <= -LINE_MAP_CORNER_US)) &&
+        ((map->lastCorner == 0) || (map->step - map->lastCorner > MAP_CORNER_GAP)))
+    {
+        /* the corner started at the step before, both are corner */
+        map->lastCorner = map->step;
+
+        if (map->state == MAP_LEARNING)
+        {
+            mapAdd(map, TRACK_SHARP, turn);
+        }
+
+        mapCorner(map, map->step - 1, turn);
+
+        type = TRACK_SHARP;
+    }
+    else
+    {
+        if ((map->state == MAP_LEARNING) && (map->step > 0))
+        {
+            mapAdd(map, map->pending, 0);
+        }
+
+        if ((map->stepTurn >= LINE_MAP_CURVE_US) || (map->stepTurn <= -LINE_MAP_CURVE_US))
+        {
+            type = TRACK_GENTLE;
+        }
+        else
+        {
+            type = TRACK_STRAIGHT;
+        }
+    }
+
+    map->pending  = type;
+    map->lastTurn = map->stepTurn;
+    map->stepTurn = 0;
+    map->step++;
+}
+
+/****************************************************************
+* Function name     : mapAdd
+*    returns        : void
+*    arg1           : map - course map being learnt
+*    arg2           : type - TRACK_ type of the next step
+*    arg3           : turn - direction of a corner, 0 otherwise
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Adds the next step of the lap, lengthening
+*                     the last segment when it is the same. A
+*                     single step of curve on a straight is only
+*                     the weave and is run into the straight.
+* Notes             : A course with more than MAP_SEGMENTS or
+*                     MAP_STEPS does not fit, the map is turned
+*                     off and the robot just follows the line
+****************************************************************/
+void mapAdd(TrackMap *map, alt_u8 type, alt_8 turn)
+{
+    MapSegment *last, *before;
+
+    alt_u32 at;
+
+    if (map->segments == 0)
+    {
+        last = &map->segment[0];
+
+        last->start  = 0;
+        last->length = 1;
+        last->type   = type;
+        last->turn   = turn;
+
+        map->segments = 1;
+
+        return;
+    }
+
+    last = &map->segment[map->segments - 1];
+
+    at = last->start + last->length;
+
+    if (at >= MAP_STEPS)
+    {
+        map->state = MAP_OFF;
+
+        return;
+    }
+
+    /* the step after a corner's first carries no direction */
+    if ((last->type == type) && ((turn == 0) || (last->turn == turn)))
+    {
+        last->length++;
+
+        return;
+    }
+
+    if ((type == TRACK_STRAIGHT) && (map->segments > 1) && (last->type == TRACK_GENTLE) &&
+        (last->length == 1))
+    {
+        before = &map->segment[map->segments - 2];
+
+        if (before->type == TRACK_STRAIGHT)
+        {
+            before->length += 2;
+
+            map->segments--;
+
+            return;
+        }
+    }
+
+    if (map->segments == MAP_SEGMENTS)
+    {
+        map->state = MAP_OFF;
+
+        return;
+    }
+
+    last = &map->segment[map->segments++];
+
+    last->start  = (alt_u16)at;
+    last->length = 1;
+    last->type   = type;
+    last->turn   = turn;
+}
+
+/****************************************************************
+* Function name     : mapCorner
+*    returns        : void
+*    arg1           : map - course map
+*    arg2           : step - step the corner started at
+*    arg3           : turn - 1 left, -1 right
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Corners are the landmarks.
+*
+*                     Learning, when the last MAP_MATCH corners
+*                     turn the same ways at the same spacing as
+*                     the first MAP_MATCH the lap may have come
+*                     round. It is only closed once every corner
+*                     of the first lap has come round again, so a
+*                     few corners repeated part way round a lap
+*                     do not close it short.
+*
+*                     Known, a corner near where the map has one
+*                     the same way moves the robot to it, which
+*                     takes out the drift of the odometry. After
+*                     MAP_LOST_MISSES corners the map does not
+*                     have, the robot has lost its place.
+*
+*                     Locating, the last MAP_MATCH corners are
+*                     looked for anywhere round the map.
+* Notes             : A course needs MAP_MATCH corners in a lap
+*                     to be learnt and no more than half of
+*                     MAP_CORNERS
+****************************************************************/
+void mapCorner(TrackMap *map, alt_u32 step, alt_8 turn)
+{
+    alt_u32 position, distance, mapped, driven, i;
+
+    alt_u8 nearest, found;
+
+    for (i = 1; i < MAP_MATCH; i++)
+    {
+        map->seen[i - 1] = map->seen[i];
+    }
+
+    map->seen[MAP_MATCH - 1].step = step;
+    map->seen[MAP_MATCH - 1].turn = turn;
+
+    if (map->state == MAP_LEARNING)
+    {
+        if (map->corners == MAP_CORNERS)
+        {
+            map->state = MAP_OFF;
+
+            return;
+        }
+
+        map->corner[map->corners].step = step;
+        map->corner[map->corners].turn = turn;
+        map->corners++;
+
+        /* since the first corners came round again every corner
+         * has to be the one a lap before */
+        if (map->repeat != 0)
+        {
+            i = map->corners - 1 - map->repeat;
+
+            mapped = map->corner[i].step - map->corner[0].step;
+            driven = step - map->corner[map->repeat].step;
+
+            if ((map->corner[i].turn != turn) ||
+                (driven > mapped + LINE_MAP_MATCH_STEPS) || (mapped > driven + LINE_MAP_MATCH_STEPS))
+            {
+                map->repeat = 0;
+            }
+        }
+
+        if ((map->repeat == 0) && (map->corners >= 2 * MAP_MATCH) && mapMatch(map, 0))
+        {
+            map->repeat = map->corners - MAP_MATCH;
+        }
+
+        /* closed once the whole of the first lap has come round */
+        if ((map->repeat != 0) && (map->corners >= 2 * map->repeat))
+        {
+            if (map->corner[map->repeat].step - map->corner[0].step > MAP_STEPS)
+            {
+                map->state = MAP_OFF;
+
+                return;
+            }
+
+            map->lapSteps = (alt_u16)(map->corner[map->repeat].step - map->corner[0].step);
+
+            mapClose(map);
+
+            /* the robot is on the last corner of the lap */
+            map->lapStart = step - map->corner[map->repeat - 1].step;
+            map->misses   = 0;
+            map->state    = MAP_KNOWN;
+        }
+    }
+    else if (map->state == MAP_KNOWN)
+    {
+        position = mapPosition(map, step);
+
+        found = 0;
+
+        for (i = 0; (i < map->corners) && !found; i++)
+        {
+            distance = (position + map->lapSteps - map->corner[i].step) % map->lapSteps;
+
+            nearest = (distance <= LINE_MAP_MATCH_STEPS) || (distance >= map->lapSteps - LINE_MAP_MATCH_STEPS);
+
+            if (nearest && (map->corner[i].turn == turn))
+            {
+                map->lapStart = step - map->corner[i].step;
+
+                found = 1;
+            }
+        }
+
+        map->misses = found ? 0 : map->misses + 1;
+
+        if (map->misses >= MAP_LOST_MISSES)
+        {
+            map->state = MAP_LOCATING;
+        }
+    }
+    else if (map->state == MAP_LOCATING)
+    {
+        for (i = 0; i < map->corners; i++)
+        {
+            if (mapMatch(map, (alt_u8)i))
+            {
+                map->lapStart = step - map->corner[(i + MAP_MATCH - 1) % map->corners].step;
+                map->misses   = 0;
+                map->state    = MAP_KNOWN;
+
+                return;
+            }
+        }
+    }
+}
+
+/****************************************************************
+* Function name     : mapMatch
+*    returns        : 1 if the last corners driven match the map
+*    arg1           : map - course map
+*    arg2           : first - map corner to match the oldest to
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : The last MAP_MATCH corners driven against
+*                     MAP_MATCH corners of the map in a row from
+*                     first, each turning the same way and no more
+*                     than LINE_MAP_MATCH_STEPS out in spacing
+* Notes             : Before the lap is known the map corners are
+*                     not wrapped round
+****************************************************************/
+alt_u8 mapMatch(const TrackMap *map, alt_u8 first)
+{
+    alt_u32 i, index, mapped, driven;
+
+    for (i = 0; i < MAP_MATCH; i++)
+    {
+        index = (first + i) % map->corners;
+
+        if (map->corner[index].turn != map->seen[i].turn)
+        {
+            return 0;
+        }
+
+        mapped = map->corner[index].step - map->corner[first].step;
+
+        if (map->lapSteps != 0)
+        {
+            mapped = (mapped + map->lapSteps) % map->lapSteps;
+        }
+
+        driven = map->seen[i].step - map->seen[0].step;
+
+        if ((driven > mapped + LINE_MAP_MATCH_STEPS) || (mapped > driven + LINE_MAP_MATCH_STEPS))
+        {
+            return 0;
         }
     }
+
+    return 1;
 }
 
+/****************************************************************
+* Function name     : mapClose
+*    returns        : void
+*    arg1           : map - course map, lapSteps just found
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Cuts the map down to one lap and works out
+*                     the speed profile for it. Known straights
+*                     are PROFILE_FULL, the LINE_MAP_BRAKE_STEPS
+*                     before each corner PROFILE_BRAKE, wrapping
+*                     round the end of the lap, and everything
+*                     else is left to the sensors.
+* Notes             : Map positions are steps since learning
+*                     started wrapped round the lap
+****************************************************************/
+void mapClose(TrackMap *map)
+{
+    MapSegment *segment;
+
+    alt_u32 i, j, first, end;
+
+    /* the corners from repeat on are the first ones again */
+    map->corners = map->repeat;
+
+    first = map->corner[0].step;
+
+    for (i = 0; i < map->lapSteps; i++)
+    {
+        map->profile[i] = PROFILE_REACTIVE;
+    }
+
+    /* one lap from the first corner, the steps before it were
+     * driven again at the end */
+    for (i = 0; i < map->segments; i++)
+    {
+        segment = &map->segment[i];
+
+        j   = (segment->start > first) ? segment->start : first;
+        end = segment->start + segment->length;
+
+        if (end > first + map->lapSteps)
+        {
+            end = first + map->lapSteps;
+        }
+
+        for (; (segment->type == TRACK_STRAIGHT) && (j < end); j++)
+        {
+            map->profile[j % map->lapSteps] = PROFILE_FULL;
+        }
+    }
+
+    for (i = 0; i < map->corners; i++)
+    {
+        map->corner[i].step %= map->lapSteps;
 
+        for (j = 1; j <= LINE_MAP_BRAKE_STEPS; j++)
+        {
+            map->profile[(map->corner[i].step + map->lapSteps - j) % map->lapSteps] = PROFILE_BRAKE;
+        }
+    }
+}
+
+/****************************************************************
+* Function name     : mapPosition
+*    returns        : step of the lap the robot is at
+*    arg1           : map - course map with the lap known
+*    arg2           : step - steps since learning started
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Wraps the odometry round the lap
+* Notes             : None
+****************************************************************/
+alt_u32 mapPosition(const TrackMap *map, alt_u32 step)
+{
+    alt_32 position;
+
+    position = (alt_32)(step - map->lapStart) % (alt_32)map->lapSteps;
+
+    return (position < 0) ? position + map->lapSteps : position;
+}
+
+/****************************************************************
+* Function name     : mapProfile
+*    returns        : PROFILE_ for where the robot is now
+*    arg1           : map - course map
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : What the speed profile says for the step
+*                     the robot is on
+* Notes             : Anything but MAP_KNOWN is PROFILE_REACTIVE
+****************************************************************/
+alt_u8 mapProfile(const TrackMap *map)
+{
+    if (map->state != MAP_KNOWN)
+    {
+        return PROFILE_REACTIVE;
+    }
+
+    return map->profile[mapPosition(map, map->step)];
+}
+
+/****************************************************************
+* Function name     : mapLost
+*    returns        : void
+*    arg1           : map - course map
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : The robot has left the line, for a spiral
+*                     or going round an obstacle. Learning starts
+*                     again from where it comes back, a known map
+*                     waits for corners to find its place again.
+* Notes             : None
+****************************************************************/
+void mapLost(TrackMap *map)
+{
+    if (map->state == MAP_LEARNING)
+    {
+        mapStart(map);
+    }
+    else if (map->state == MAP_KNOWN)
+    {
+        map->state  = MAP_LOCATING;
+        map->misses = 0;
+    }
+}
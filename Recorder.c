@@ -0,0 +1,570 @@
+/*****************************************************************
+* Module name: Recorder
+*
+* Copyright 1997 Company as an unpublished work.
+* All Rights Reserved.
+*
+* The information contained herein is confidential
+* property of Company. The user, copying, transfer or
+* disclosure of such information is prohibited except
+* by express written agreement with Company.
+*
+* First written on 19/10/26 by Connor Parker.
+*
+* Module Description:
+* -------------------
+* Input recording and, with RECORDER_REPLAY, playback. See
+* Recorder.h for the stream format.
+*
+*****************************************************************
+*  Includes section
+*****************************************************************/
+
+#include "alt_types.h"
+
+#include "Control.h"
+#include "Recorder.h"
+
+/*****************************************************************
+*  Defines section
+*****************************************************************/
+
+/* Longest item, a tag and three 5 byte numbers */
+#define REC_MAX_ITEM 16
+
+#define TAG(type, number) ((alt_u8)(((type) << 5) | ((number) & 0xF)))
+#define TAG_MORE          0x10
+
+/* No command has been given yet */
+#define NO_COMMAND 0xFFFFFFFF
+
+/*****************************************************************
+*  Variables section
+*****************************************************************/
+
+Recording recording;
+
+/* last value of each kind, both recording and replaying keep
+ * these so the deltas line up */
+static alt_u32 lastInputs;
+static alt_u32 lastAdc;
+static alt_u32 lastValue;
+static alt_u32 lastStamp;
+static alt_u32 lastHeader;
+static alt_u32 lastCommand;
+static alt_u32 lastStepper;
+
+/* header reads still to come out of the current REC_REPEAT */
+static alt_u32 repeats;
+
+#ifdef RECORDER_REPLAY
+static alt_u32 position;
+static alt_u32 commands;
+static alt_u32 replayTicks;
+#else
+static alt_u32 lastTicks;
+#endif
+
+/*****************************************************************
+*  Function Prototype Section
+*****************************************************************/
+
+#ifdef RECORDER_REPLAY
+static alt_32 unzigzag(alt_u32 number);
+static alt_u8 getByte(void);
+static alt_u32 getVarint(void);
+static alt_u32 expect(alt_u8 type);
+#else
+static alt_u32 zigzag(alt_32 delta);
+static alt_u8 beginItem(void);
+static void putByte(alt_u8 byte);
+static void putVarint(alt_u32 number);
+static void putNumber(alt_u8 type, alt_u32 number);
+#endif
+
+/****************************************************************/
+
+/****************************************************************
+* Function name     : recorderInit
+*    returns        : void
+*    arg1           : void
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Starts a new recording, or when replaying
+*                     goes back to the start of the one loaded
+* Notes             : Called by controlStart()
+****************************************************************/
+void recorderInit(void)
+{
+    lastInputs  = 0xFFFFFFFF;
+    lastAdc     = 0;
+    lastValue   = 0;
+    lastStamp   = 0;
+    lastHeader  = 0xFFFFFFFF;
+    lastCommand = NO_COMMAND;
+    lastStepper = NO_COMMAND;
+    repeats     = 0;
+
+#ifdef RECORDER_REPLAY
+    position    = 0;
+    commands    = 0;
+    replayTicks = 0;
+#else
+    lastTicks   = 0;
+
+    recording.magic = RECORD_MAGIC;
+    recording.used  = 0;
+    recording.full  = 0;
+#endif
+}
+
+#ifndef RECORDER_REPLAY
+
+/****************************************************************
+* Function name     : recorderInputs
+*    returns        : header, unchanged
+*    arg1           : header - debounced header about to be
+*                     handed to the behaviour code
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Records a header read. The same value as
+*                     last time only adds to a count.
+* Notes             : n/a
+****************************************************************/
+alt_u32 recorderInputs(alt_u32 header)
+{
+    if (header == lastInputs)
+    {
+        repeats++;
+    }
+    else if (beginItem())
+    {
+        putNumber(REC_INPUTS, header ^ lastInputs);
+
+        lastInputs = header;
+    }
+
+    return header;
+}
+
+/****************************************************************
+* Function name     : recorderAdc
+*    returns        : value, unchanged
+*    arg1           : value - ADC reading about to be handed to
+*                     the behaviour code
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Records an ADC read
+* Notes             : n/a
+****************************************************************/
+alt_u16 recorderAdc(alt_u16 value)
+{
+    if (beginItem())
+    {
+        putNumber(REC_ADC, zigzag((alt_32)value - (alt_32)lastAdc));
+
+        lastAdc = value;
+    }
+
+    return value;
+}
+
+/****************************************************************
+* Function name     : recorderValue
+*    returns        : value, unchanged
+*    arg1           : value - any other input, e.g. a timestamp
+*                     or a random number
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Records a value the behaviour code will act
+*                     on that did not come from Control
+* Notes             : Wrap the call that makes the value, e.g.
+*                     recorderValue(rand())
+****************************************************************/
+alt_u32 recorderValue(alt_u32 value)
+{
+    if (beginItem())
+    {
+        putNumber(REC_VALUE, zigzag((alt_32)(value - lastValue)));
+
+        lastValue = value;
+    }
+
+    return value;
+}
+
+/****************************************************************
+* Function name     : recorderEvent
+*    returns        : taken, unchanged
+*    arg1           : taken - TRUE (1) if an event was taken off
+*                     the queue
+*    arg2           : event - the event taken
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Records the result of eventQueueTake()
+* Notes             : n/a
+****************************************************************/
+alt_u8 recorderEvent(alt_u8 taken, SensorEvent *event)
+{
+    if (beginItem())
+    {
+        putNumber(REC_EVENT, taken);
+
+        if (taken)
+        {
+            putVarint(zigzag((alt_32)(event->timestamp - lastStamp)));
+            putVarint(event->header ^ lastHeader);
+            putVarint(event->changed);
+
+            lastStamp  = event->timestamp;
+            lastHeader = event->header;
+        }
+    }
+
+    return taken;
+}
+
+/****************************************************************
+* Function name     : recorderMotors
+*    returns        : void
+*    arg1           : motors - motor nibble
+*    arg2           : left - left wheel duty
+*    arg3           : right - right wheel duty
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Records a motor command if it differs from
+*                     the last one. The usual single duty takes
+*                     one byte, a steered command two.
+* Notes             : n/a
+****************************************************************/
+void recorderMotors(alt_u32 motors, alt_u8 left, alt_u8 right)
+{
+    alt_u32 command;
+
+    command = ((alt_u32)right << 16) | ((alt_u32)left << 8) | (motors & 0xF);
+
+    if ((command != lastCommand) && beginItem())
+    {
+        if (left == right)
+        {
+            putNumber(REC_MOTORS, motors & 0xF);
+            putByte(left);
+        }
+        else
+        {
+            putNumber(REC_MOTORS, (motors & 0xF) | REC_SPLIT);
+            putByte(left);
+            putByte(right);
+        }
+
+        lastCommand = command;
+    }
+}
+
+/****************************************************************
+* Function name     : recorderStepper
+*    returns        : void
+*    arg1           : nibble - stepper coil pattern
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Records a stepper command if it differs from
+*                     the last one
+* Notes             : n/a
+****************************************************************/
+void recorderStepper(alt_u32 nibble)
+{
+    if ((nibble != lastStepper) && beginItem())
+    {
+        putNumber(REC_STEPPER, nibble & 0xF);
+
+        lastStepper = nibble;
+    }
+}
+
+/****************************************************************
+* Function name     : beginItem
+*    returns        : TRUE (1) if there is room for an item
+*    arg1           : void
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Writes out any pending repeat count and the
+*                     time since the last timed item, then checks
+*                     a whole item will fit
+* Notes             : Once an item does not fit the recording is
+*                     marked full and stops, so it never ends part
+*                     way through an item
+****************************************************************/
+static alt_u8 beginItem(void)
+{
+    alt_u32 ticks;
+
+    if (recording.full || ((recording.used + (3 * REC_MAX_ITEM)) > RECORD_BUFFER_SIZE))
+    {
+        recording.full = 1;
+
+        return 0;
+    }
+
+    if (repeats)
+    {
+        putNumber(REC_REPEAT, repeats);
+
+        repeats = 0;
+    }
+
+    ticks = controlTicks();
+
+    if (ticks != lastTicks)
+    {
+        putNumber(REC_TIME, ticks - lastTicks);
+
+        lastTicks = ticks;
+    }
+
+    return 1;
+}
+
+static void putByte(alt_u8 byte)
+{
+    recording.data[recording.used++] = byte;
+}
+
+/* 7 bits a byte, low first, top bit set if more follow */
+static void putVarint(alt_u32 number)
+{
+    while (number >= 0x80)
+    {
+        putByte((alt_u8)(number | 0x80));
+
+        number >>= 7;
+    }
+
+    putByte((alt_u8)number);
+}
+
+/* signed deltas as unsigned, small either way stays small */
+static alt_u32 zigzag(alt_32 delta)
+{
+    return ((alt_u32)delta << 1) ^ (alt_u32)(delta >> 31);
+}
+
+/* tag carrying the low 4 bits, then the rest if there is any */
+static void putNumber(alt_u8 type, alt_u32 number)
+{
+    if (number >> 4)
+    {
+        putByte(TAG(type, number) | TAG_MORE);
+        putVarint(number >> 4);
+    }
+    else
+    {
+        putByte(TAG(type, number));
+    }
+}
+
+#else /* RECORDER_REPLAY */
+
+/****************************************************************
+* Function name     : recorderInputs (replay)
+*    returns        : header read at this point in the recording
+*    arg1           : header - live value, ignored
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Plays back a header read
+* Notes             : The replay versions below all work the same
+*                     way, the next item must be the kind asked
+*                     for or the replay has diverged
+****************************************************************/
+alt_u32 recorderInputs(alt_u32 header)
+{
+    (void)header;
+
+    if (repeats)
+    {
+        repeats--;
+
+        return lastInputs;
+    }
+
+    /* a run of repeats always comes straight after the item before
+     * it, so peek for one */
+    if ((position < recording.used) && ((recording.data[position] >> 5) == REC_REPEAT))
+    {
+        repeats = expect(REC_REPEAT) - 1;
+
+        return lastInputs;
+    }
+
+    lastInputs ^= expect(REC_INPUTS);
+
+    return lastInputs;
+}
+
+alt_u16 recorderAdc(alt_u16 value)
+{
+    (void)value;
+
+    lastAdc += unzigzag(expect(REC_ADC));
+
+    return (alt_u16)lastAdc;
+}
+
+alt_u32 recorderValue(alt_u32 value)
+{
+    (void)value;
+
+    lastValue += unzigzag(expect(REC_VALUE));
+
+    return lastValue;
+}
+
+alt_u8 recorderEvent(alt_u8 taken, SensorEvent *event)
+{
+    (void)taken;
+
+    if (!expect(REC_EVENT))
+    {
+        return 0;
+    }
+
+    lastStamp  += unzigzag(getVarint());
+    lastHeader ^= getVarint();
+
+    event->timestamp = lastStamp;
+    event->header    = lastHeader;
+    event->changed   = getVarint();
+
+    return 1;
+}
+
+void recorderMotors(alt_u32 motors, alt_u8 left, alt_u8 right)
+{
+    alt_u32 command, number;
+    alt_u8 recordedLeft, recordedRight;
+
+    command = ((alt_u32)right << 16) | ((alt_u32)left << 8) | (motors & 0xF);
+
+    if (command == lastCommand)
+    {
+        return;
+    }
+
+    number = expect(REC_MOTORS);
+
+    recordedLeft  = getByte();
+    recordedRight = (number & REC_SPLIT) ? getByte() : recordedLeft;
+
+    if (((number & 0xF) != (motors & 0xF)) || (recordedLeft != left) || (recordedRight != right))
+    {
+        recorderReplayEnd(REPLAY_DIVERGED);
+    }
+
+    lastCommand = command;
+    commands++;
+}
+
+void recorderStepper(alt_u32 nibble)
+{
+    if (nibble == lastStepper)
+    {
+        return;
+    }
+
+    if (expect(REC_STEPPER) != (nibble & 0xF))
+    {
+        recorderReplayEnd(REPLAY_DIVERGED);
+    }
+
+    lastStepper = nibble;
+    commands++;
+}
+
+alt_u32 recorderReplayCommands(void)
+{
+    return commands;
+}
+
+alt_u32 recorderReplayTicks(void)
+{
+    return replayTicks;
+}
+
+alt_u32 recorderReplayOffset(void)
+{
+    return position;
+}
+
+static alt_u8 getByte(void)
+{
+    if (position >= recording.used)
+    {
+        recorderReplayEnd(REPLAY_END);
+    }
+
+    return recording.data[position++];
+}
+
+static alt_u32 getVarint(void)
+{
+    alt_u32 number, shift;
+    alt_u8 byte;
+
+    number = 0;
+    shift  = 0;
+
+    do
+    {
+        byte = getByte();
+
+        number |= (alt_u32)(byte & 0x7F) << shift;
+        shift  += 7;
+    } while (byte & 0x80);
+
+    return number;
+}
+
+/* next item, which must be of this type, skipping times */
+static alt_u32 expect(alt_u8 type)
+{
+    alt_u32 number;
+    alt_u8 tag;
+
+    /* a header read was recorded that the module has not made */
+    if (repeats)
+    {
+        recorderReplayEnd(REPLAY_DIVERGED);
+    }
+
+    while (1)
+    {
+        tag = getByte();
+
+        number = tag & 0xF;
+
+        if (tag & TAG_MORE)
+        {
+            number |= getVarint() << 4;
+        }
+
+        if ((tag >> 5) != REC_TIME)
+        {
+            break;
+        }
+
+        replayTicks += number;
+    }
+
+    if ((tag >> 5) != type)
+    {
+        recorderReplayEnd(REPLAY_DIVERGED);
+    }
+
+    return number;
+}
+
+static alt_32 unzigzag(alt_u32 number)
+{
+    return (alt_32)(number >> 1) ^ -(alt_32)(number & 1);
+}
+
+#endif /* RECORDER_REPLAY */
@@ -0,0 +1,143 @@
+/*****************************************************************
+* Module name: Recorder
+*
+* Copyright 1997 Company as an unpublished work.
+* All Rights Reserved.
+*
+* The information contained herein is confidential
+* property of Company. The user, copying, transfer or
+* disclosure of such information is prohibited except
+* by express written agreement with Company.
+*
+* First written on 19/10/26 by Connor Parker.
+*
+* Module Description:
+* -------------------
+* Records everything the behaviour code reads and every motor and
+* stepper command it gives, so a run can be replayed on the PC
+* and come out the same.
+*
+*    Every input a module acts on passes through a recorder call
+*    on its way in: header and ADC reads in Control, events in
+*    EventQueue, and anything else (timestamps, rand()) through
+*    recorderValue()
+*
+*    Each item is delta coded against the last one of its kind
+*    and a header read that did not change is one count in a
+*    run, so a module polling a quiet header costs next to
+*    nothing. Commands are only stored when they change.
+*
+*    Recording starts with controlStart() and stops when the
+*    buffer is full, keeping the start of the run
+*
+* To get a recording off the robot after a run stop it in the
+* debugger and dump the used part of the recording structure,
+* e.g. from nios2-elf-gdb:
+*
+*    dump binary memory run.rec &recording &recording.data[recording.used]
+*
+* host/replay then runs a module against it. Built with
+* RECORDER_REPLAY defined the same calls play the recording back
+* instead, ignoring the live value and checking every command
+* against the one recorded.
+*
+* Stream format, one tag byte per item:
+*
+*    bits 7-5   item type, REC_*
+*    bit  4     set if more bytes of the number follow
+*    bits 3-0   low 4 bits of the number
+*
+* the rest of the number follows 7 bits a byte, low first, top
+* bit set on all but the last. Signed deltas are zigzag coded.
+*
+*****************************************************************/
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "alt_types.h"
+
+#include "EventQueue.h"
+
+/*****************************************************************
+*  Defines section
+*****************************************************************/
+
+/* Bytes of recording kept, about 160s of LineFollower, enough
+ * for three laps and the laps it drives from its course map */
+#define RECORD_BUFFER_SIZE (2 * 1024 * 1024)
+
+#define RECORD_MAGIC 0x31434552    /* "REC1" */
+
+/* Item types */
+#define REC_TIME     0  /* Control ticks since the last REC_TIME        */
+#define REC_REPEAT   1  /* header read the same this many more times    */
+#define REC_INPUTS   2  /* header read, xor with the last one           */
+#define REC_ADC      3  /* ADC read, zigzag delta from the last one     */
+#define REC_VALUE    4  /* recorderValue(), zigzag delta from the last  */
+#define REC_MOTORS   5  /* number is the motor nibble, duty byte after,
+                         * or with REC_SPLIT left then right duty      */
+#define REC_STEPPER  6  /* number is the stepper nibble                 */
+#define REC_EVENT    7  /* number 0 queue empty, 1 event follows as
+                         * three numbers: zigzag timestamp delta,
+                         * header xor last event header, changed bits  */
+
+/* REC_MOTORS number bit for wheels at different duties */
+#define REC_SPLIT    0x10
+
+/* How a replay finished */
+#define REPLAY_END      0  /* ran off the end of the recording   */
+#define REPLAY_DIVERGED 1  /* module asked for something else    */
+
+/*****************************************************************
+*  Types section
+*****************************************************************/
+
+typedef struct
+{
+    alt_u32 magic;
+    alt_u32 used;       /* bytes of data filled                  */
+    alt_u32 full;       /* recording stopped early, data is full */
+    alt_u8  data[RECORD_BUFFER_SIZE];
+} Recording;
+
+/*****************************************************************
+*  Global Variables Section
+*****************************************************************/
+
+extern Recording recording;
+
+/*****************************************************************
+*  Function Prototype Section
+*****************************************************************/
+
+void recorderInit(void);
+
+alt_u32 recorderInputs(alt_u32 header);
+
+alt_u16 recorderAdc(alt_u16 value);
+
+alt_u32 recorderValue(alt_u32 value);
+
+alt_u8 recorderEvent(alt_u8 taken, SensorEvent *event);
+
+void recorderMotors(alt_u32 motors, alt_u8 left, alt_u8 right);
+
+void recorderStepper(alt_u32 nibble);
+
+#ifdef RECORDER_REPLAY
+
+/* Replay progress, for the driver to report */
+alt_u32 recorderReplayCommands(void);
+
+alt_u32 recorderReplayTicks(void);
+
+alt_u32 recorderReplayOffset(void);
+
+/* Supplied by the replay driver, called when the replay stops.
+ * Must not return. */
+void recorderReplayEnd(alt_u8 reason);
+
+#endif
+
+#endif
@@ -0,0 +1,253 @@
+/*****************************************************************
+* Module name: Telemetry
+*
+* Copyright 1997 Company as an unpublished work.
+* All Rights Reserved.
+*
+* The information contained herein is confidential
+* property of Company. The user, copying, transfer or
+* disclosure of such information is prohibited except
+* by express written agreement with Company.
+*
+* First written on 19/10/26 by Connor Parker.
+*
+* Module Description:
+* -------------------
+* Non blocking binary telemetry framer, see Telemetry.h for the
+* record layout.
+*
+*****************************************************************
+*  Includes section
+*****************************************************************/
+
+/* Standard Altera include files to enable the mapping of names
+To hardware addresses etc. */
+#include "system.h"
+#include "altera_avalon_jtag_uart_regs.h"
+#include "alt_types.h"
+#include "sys/alt_irq.h"
+#include "sys/alt_timestamp.h"
+
+#include "Telemetry.h"
+
+/*****************************************************************
+*  Defines section
+*****************************************************************/
+
+/* Stops the compiler moving memory accesses across this point,
+ * the buffer is shared between the main loop and the ISR */
+#define COMPILER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+#define TELEMETRY_BUFFER_MASK (TELEMETRY_BUFFER_SIZE - 1)
+
+/*****************************************************************
+*  Variables section
+*****************************************************************/
+
+/* bytes waiting for the UART, head only moved by the main loop
+ * and tail only by the ISR */
+static alt_u8 txBuffer[TELEMETRY_BUFFER_SIZE];
+static volatile alt_u32 txHead;
+static volatile alt_u32 txTail;
+
+/* only every recordEvery'th call to telemetryRecord is kept */
+static alt_u8 recordEvery;
+static alt_u8 recordCount;
+
+static alt_u8  sequence;
+static alt_u32 dropped;
+
+/* header sensor bits the module sends */
+static alt_u32 sensorMask;
+
+/*****************************************************************
+*  Function Prototype Section
+*****************************************************************/
+
+static void jtagUartIsr(void *context);
+
+/****************************************************************/
+
+/****************************************************************
+* Function name     : telemetryInit
+*    returns        : void
+*    arg1           : every - keep one record in this many calls
+*                     to telemetryRecord, 1 keeps them all
+*    arg2           : sensors - header sensor bits the module
+*                     sends, the rest are left out of every record
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Empties the buffer, starts the timestamp
+*                     timer and hooks the JTAG UART interrupt
+* Notes             : Call once at start up before the main loop
+****************************************************************/
+void telemetryInit(alt_u8 every, alt_u32 sensors)
+{
+    txHead = 0;
+    txTail = 0;
+
+    recordEvery = (every == 0) ? 1 : every;
+    recordCount = 0;
+
+    sequence = 0;
+    dropped  = 0;
+
+    sensorMask = sensors;
+
+    alt_timestamp_start();
+
+    /* write interrupt stays off until there is something to send */
+    IOWR_ALTERA_AVALON_JTAG_UART_CONTROL(JTAG_UART_BASE, 0);
+
+    alt_ic_isr_register(JTAG_UART_IRQ_INTERRUPT_CONTROLLER_ID,
+                        JTAG_UART_IRQ, jtagUartIsr, 0x0, 0x0);
+}
+
+/****************************************************************
+* Function name     : telemetryRecord
+*    returns        : void
+*    arg1           : header - header word, bits other than the
+*                     sensors given to telemetryInit are cleared
+*    arg2           : motor - motor nibble last written
+*    arg3           : stepper - stepper step index or
+*                     TELEMETRY_NO_STEPPER
+*    arg4           : adc - last ADC value, 0 if not used
+*    arg5           : state - behaviour state of the module
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Packs a record into the buffer and wakes the
+*                     UART interrupt to send it. Never waits, if
+*                     the buffer is full the record is dropped.
+* Notes             : Cheap enough to call once per control loop,
+*                     a 16 byte copy and a checksum
+****************************************************************/
+void telemetryRecord(alt_u32 header, alt_u8 motor, alt_u8 stepper, alt_u16 adc, alt_u8 state)
+{
+    alt_u8 record[TELEMETRY_RECORD_SIZE];
+    alt_u32 tick, head, i;
+    alt_u8 checksum;
+
+    recordCount++;
+
+    if (recordCount < recordEvery)
+    {
+        return;
+    }
+
+    recordCount = 0;
+
+    /* sequence moves on even if the record is dropped so the
+     * host can see the gap */
+    sequence++;
+
+    head = txHead;
+
+    if ((TELEMETRY_BUFFER_SIZE - (head - txTail)) < TELEMETRY_RECORD_SIZE)
+    {
+        dropped++;
+
+        return;
+    }
+
+    tick = (alt_u32)alt_timestamp();
+
+    record[0]  = TELEMETRY_SYNC;
+    record[1]  = sequence;
+    record[2]  = (alt_u8)(tick);
+    record[3]  = (alt_u8)(tick >> 8);
+    record[4]  = (alt_u8)(tick >> 16);
+    record[5]  = (alt_u8)(tick >> 24);
+    header &= sensorMask;
+
+    record[6]  = (alt_u8)(header);
+    record[7]  = (alt_u8)(header >> 8);
+    record[8]  = (alt_u8)(header >> 16);
+    record[9]  = (alt_u8)(sensorMask >> TELEMETRY_SENSOR_SHIFT);
+    record[10] = (alt_u8)(adc);
+    record[11] = (alt_u8)(adc >> 8);
+    record[12] = motor;
+    record[13] = stepper;
+    record[14] = state;
+
+    checksum = 0;
+
+    for (i = 1; i < (TELEMETRY_RECORD_SIZE - 1); i++)
+    {
+        checksum += record[i];
+    }
+
+    record[TELEMETRY_RECORD_SIZE - 1] = checksum;
+
+    for (i = 0; i < TELEMETRY_RECORD_SIZE; i++)
+    {
+        txBuffer[(head + i) & TELEMETRY_BUFFER_MASK] = record[i];
+    }
+
+    /* bytes must be in the buffer before the ISR can see them */
+    COMPILER_BARRIER();
+
+    txHead = head + TELEMETRY_RECORD_SIZE;
+
+    /* turn on the write interrupt, if the ISR has already sent
+     * everything it just turns itself off again */
+    IOWR_ALTERA_AVALON_JTAG_UART_CONTROL(JTAG_UART_BASE, ALTERA_AVALON_JTAG_UART_CONTROL_WE_MSK);
+}
+
+/****************************************************************
+* Function name     : telemetryDropped
+*    returns        : number of records dropped because the
+*                     buffer was full
+*    arg1           : void
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Lets a module check if it is recording
+*                     faster than the UART can send
+* Notes             : n/a
+****************************************************************/
+alt_u32 telemetryDropped(void)
+{
+    return dropped;
+}
+
+/****************************************************************
+* Function name     : jtagUartIsr
+*    returns        : void
+*    arg1           : context - unused
+* Created by        : Connor Parker
+* Date created      : 19/10/26
+* Description       : Fills the UART write FIFO from the buffer.
+*                     Turns the write interrupt off once the
+*                     buffer is empty.
+* Notes             : n/a
+****************************************************************/
+static void jtagUartIsr(void *context)
+{
+    alt_u32 control, space, tail, head;
+
+    (void)context;
+
+    control = IORD_ALTERA_AVALON_JTAG_UART_CONTROL(JTAG_UART_BASE);
+
+    space = (control & ALTERA_AVALON_JTAG_UART_CONTROL_WSPACE_MSK) >> ALTERA_AVALON_JTAG_UART_CONTROL_WSPACE_OFST;
+
+    tail = txTail;
+    head = txHead;
+
+    while ((space > 0) && (tail != head))
+    {
+        IOWR_ALTERA_AVALON_JTAG_UART_DATA(JTAG_UART_BASE, txBuffer[tail & TELEMETRY_BUFFER_MASK]);
+
+        tail++;
+        space--;
+    }
+
+    /* bytes must be sent before the main loop can reuse them */
+    COMPILER_BARRIER();
+
+    txTail = tail;
+
+    if (tail == head)
+    {
+        IOWR_ALTERA_AVALON_JTAG_UART_CONTROL(JTAG_UART_BASE, 0);
+    }
+}
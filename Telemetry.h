@@ -0,0 +1,82 @@
+/*****************************************************************
+* Module name: Telemetry
+*
+* Copyright 1997 Company as an unpublished work.
+* All Rights Reserved.
+*
+* The information contained herein is confidential
+* property of Company. The user, copying, transfer or
+* disclosure of such information is prohibited except
+* by express written agreement with Company.
+*
+* First written on 19/10/26 by Connor Parker.
+*
+* Module Description:
+* -------------------
+* Binary telemetry over the JTAG UART that never blocks the
+* control loop.
+*
+*    telemetryRecord() packs one fixed layout record into a RAM
+*    buffer and returns straight away, if there is no room the
+*    record is dropped rather than waiting
+*
+*    The JTAG UART write interrupt empties the buffer into the
+*    UART FIFO in the background
+*
+*    host/telemdec turns the byte stream back into CSV
+*
+* The JTAG UART must not also be the HAL stdout/stderr device
+* (set hal.stdout, hal.stderr and hal.stdin to none in the BSP)
+* as its driver would fight over the same interrupt.
+*
+* Record layout, little endian, TELEMETRY_RECORD_SIZE bytes:
+*
+*    byte  0      TELEMETRY_SYNC
+*    byte  1      sequence number, goes up by one every record
+*                 offered so gaps show dropped records
+*    bytes 2-5    tick, alt_timestamp() when recorded
+*    bytes 6-8    header word bits 0-23, only the sensor bits kept
+*    byte  9      which sensor bits the module sends, header bits
+*                 from TELEMETRY_SENSOR_SHIFT up. Sensors are active
+*                 low, so a bit not sent would read as active
+*    bytes 10-11  ADC value
+*    byte  12     motor nibble written to the header
+*    byte  13     stepper step index or TELEMETRY_NO_STEPPER
+*    byte  14     behaviour state, meaning is per module
+*    byte  15     checksum, sum of bytes 1 to 14
+*
+*****************************************************************/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "alt_types.h"
+
+/*****************************************************************
+*  Defines section
+*****************************************************************/
+
+#define TELEMETRY_SYNC        0xA5
+#define TELEMETRY_RECORD_SIZE 16
+
+/* Lowest header sensor bit, the right bumper. The sensors are
+ * all in the 8 bits from here */
+#define TELEMETRY_SENSOR_SHIFT 11
+
+/* stepper field value for modules without a stepper */
+#define TELEMETRY_NO_STEPPER  0xFF
+
+/* Bytes of RAM buffer, must be a power of 2 */
+#define TELEMETRY_BUFFER_SIZE 1024
+
+/*****************************************************************
+*  Function Prototype Section
+*****************************************************************/
+
+void telemetryInit(alt_u8 every, alt_u32 sensors);
+
+void telemetryRecord(alt_u32 header, alt_u8 motor, alt_u8 stepper, alt_u16 adc, alt_u8 state);
+
+alt_u32 telemetryDropped(void);
+
+#endif
@@ -0,0 +1,163 @@
+/*******************************************************************************
+ * Program Name         : arena.c
+ * Project              : Marco Robot Coursework - host tools
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Runs a crowd of robots with the same module in one
+ *                        shared world (see sim/arena.c) and reports how the
+ *                        crowd got on and how fast the simulator kept up.
+ *
+ *                        Usage: arena [-s line|light|escape|obstacle]
+ *                                     [-n robots] [-j threads]
+ *                                     [-S first_seed] [-l laps] [-L limit_s]
+ *                                     [-f FAULT=LEVEL]... [-p NAME=VALUE]...
+ *                                     [-r]
+ *
+ *                        Robot n has seed first_seed + n. -j 0, the default,
+ *                        uses a thread a processor. -f and -p are as for
+ *                        bench. -r adds a line for every robot.
+ *
+ *                        Robots start SIM_CROWD_SPACING apart, so the line
+ *                        and obstacle courses hold 28 and the light and
+ *                        escape rooms 121 and 64 (the usage lists them).
+ *                        Past about 14 round a course a robot that backs
+ *                        off a bump can jam the ones behind it: 14 all
+ *                        finish, 18 jammed (0 finished), 22 all finished,
+ *                        28 jammed (1 finished), so a crowd of 64 needs
+ *                        light or escape.
+ *
+ *                        contacts counts each time a robot came up against
+ *                        another, safe% is the share of the run the modules
+ *                        spent stopped by their bumpers, done_per_min is
+ *                        robots finished a simulated minute and x_real is
+ *                        simulated seconds a real second.
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim/sim.h"
+
+static void usage(void);
+
+int main(int argc, char *argv[])
+{
+    SimArenaConfig cfg;
+    SimArenaResult result;
+    const SimArenaRobot *r;
+    int scenario = SIM_LIGHT, showRobots = 0, i, t;
+    double *times, total = 0, safety = 0, ticks = 0;
+    char *eq;
+
+    simTunablesReset();
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.robots = 16;
+
+    // scenario first so the other options land on top of its defaults
+    for(i = 1; i + 1 < argc; i++)
+        if(!strcmp(argv[i], "-s")){
+            scenario = simScenarioFind(argv[i + 1]);
+            if(scenario < 0)
+                usage();
+        }
+    simConfigDefaults(&cfg.run, scenario);
+
+    for(i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "-s") && i + 1 < argc)
+            i++;
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            cfg.robots = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-j") && i + 1 < argc)
+            cfg.threads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-S") && i + 1 < argc)
+            cfg.run.seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if(!strcmp(argv[i], "-l") && i + 1 < argc)
+            cfg.run.laps = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-L") && i + 1 < argc)
+            cfg.run.limitS = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-r"))
+            showRobots = 1;
+        else if(!strcmp(argv[i], "-f") && i + 1 < argc){
+            eq = strchr(argv[++i], '=');
+            if(!eq)
+                usage();
+            *eq = '\0';
+            if(simFaultSet(&cfg.run.faults, argv[i], atof(eq + 1)) < 0){
+                fprintf(stderr, "arena: no fault called %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "-p") && i + 1 < argc){
+            eq = strchr(argv[++i], '=');
+            if(!eq)
+                usage();
+            *eq = '\0';
+            t = simTunableFind(argv[i]);
+            if(t < 0){
+                fprintf(stderr, "arena: no tunable called %s\n", argv[i]);
+                return 1;
+            }
+            simTunable[t] = atol(eq + 1);
+        }
+        else
+            usage();
+    }
+    if(cfg.robots < 1 || cfg.run.limitS <= 0)
+        usage();
+
+    if(simArenaRun(&cfg, &result) < 0)
+        return 1;
+
+    times = malloc(result.robots * sizeof(double));
+    for(i = 0; i < result.robots; i++){
+        r = &result.robot[i];
+        times[i] = r->timeS;
+        total += r->timeS;
+        safety += r->control.safetyTicks;
+        ticks += r->control.ticks;
+    }
+    simSort(times, result.robots);
+
+    if(showRobots){
+        printf("%5s %10s %3s %9s %8s %8s %6s\n", "robot", "seed", "ok", "time_s", "dist_m", "contacts", "safe%");
+        for(i = 0; i < result.robots; i++){
+            r = &result.robot[i];
+            printf("%5d %10u %3d %9.2f %8.2f %8d %6.1f\n", i, r->seed, r->success, r->timeS, r->distanceM,
+                   r->contacts, r->control.ticks ? 100.0 * r->control.safetyTicks / r->control.ticks : 0.0);
+        }
+        printf("\n");
+    }
+
+    printf("%-8s %6s %7s %5s %8s %9s %9s %9s %6s %12s %8s %8s %7s\n", "scenario", "robots", "threads", "ok",
+           "contacts", "mean_s", "p50_s", "max_s", "safe%", "done_per_min", "sim_s", "wall_s", "x_real");
+    printf("%-8s %6d %7d %5d %8d %9.2f %9.2f %9.2f %6.1f %12.2f %8.2f %8.2f %7.2f\n", simScenarioName(scenario),
+           result.robots, result.threads, result.finished, result.contacts, total / result.robots,
+           simPercentile(times, result.robots, 50), times[result.robots - 1], ticks > 0 ? 100.0 * safety / ticks : 0.0,
+           result.simS > 0 ? result.finished * 60.0 / result.simS : 0.0, result.simS, result.wallS,
+           result.wallS > 0 ? result.simS / result.wallS : 0.0);
+
+    free(times);
+    simArenaFree(&result);
+    return 0;
+}
+
+static void usage(void)
+{
+    SimConfig cfg;
+    SimWorld world;
+    int s;
+
+    fprintf(stderr, "usage: arena [-s line|light|escape|obstacle] [-n robots] [-j threads]\n"
+                    "             [-S first_seed] [-l laps] [-L limit_s]\n"
+                    "             [-f FAULT=LEVEL]... [-p NAME=VALUE]... [-r]\n"
+                    "most robots:");
+    for(s = 0; s < SIM_SCENARIOS; s++){
+        simConfigDefaults(&cfg, s);
+        simWorldInit(&world, &cfg);
+        fprintf(stderr, " %s %d", simScenarioName(s), simWorldCapacity(&world));
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+}
@@ -0,0 +1,490 @@
+/*******************************************************************************
+ * Program Name         : autotune.c
+ * Project              : Marco Robot Coursework - host tools
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Searches the tuning constants of each module (see
+ *                        sim/tunables.def) for the settings that finish the
+ *                        simulated benchmark fastest and most reliably, then
+ *                        writes them out as TunedParams.h for the modules to
+ *                        be built with -DUSE_TUNED_PARAMS.
+ *
+ *                        Usage: autotune [-s line|light|escape|obstacle] [-n seeds]
+ *                                        [-j jobs] [-b budget] [-o header]
+ *
+ *                        The search is a coarse grid over each constant's
+ *                        range (sampled if the full grid is over half the
+ *                        budget) then a pattern search around the best
+ *                        points with a shrinking step. A constant with a
+ *                        step in tunables.def only takes values on it.
+ *                        Constants that only matter after the first lap,
+ *                        such as the line course map, are searched on their
+ *                        own afterwards over as many laps as they need,
+ *                        with the rest of the scenario as tuned. Every candidate is run
+ *                        on the same seeds so they are compared on the same
+ *                        starts. Candidates are run in forked workers, -j at
+ *                        a time, defaulting to one per core.
+ *
+ *                        Each candidate is scored on two things, the mean
+ *                        time of its successful runs and the fraction of runs
+ *                        that failed. The header gets the Pareto front of the
+ *                        two as comments and, as the defines, the point on it
+ *                        with the lowest mean time when failures count as the
+ *                        time limit.
+ *******************************************************************************/
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sim/sim.h"
+
+#define GRID_LEVELS     3
+#define MAX_PARAMS      TUN_COUNT
+#define MAX_FRONT       8
+
+typedef struct
+{
+    long value[MAX_PARAMS];     // one per searched tunable
+    double meanOk;              // mean time of the runs that finished
+    double failRate;
+    double score;               // mean time with failures at the limit
+    int done;
+} Candidate;
+
+typedef struct
+{
+    int scenario;
+    int laps;                   // laps each run goes round
+    int params[MAX_PARAMS];     // tunable index of each searched constant
+    int nParams;
+    int seeds;
+    int jobs;
+    double limitS;
+    Candidate *all;             // every candidate evaluated so far
+    int nAll, maxAll;
+} Search;
+
+static void tuneScenario(Search *search, int budget);
+static void evaluate(Search *search, Candidate *batch, int n);
+static void runCandidate(const Search *search, Candidate *c);
+static int seen(const Search *search, const Candidate *c);
+static void clampCandidate(const Search *search, Candidate *c);
+static int better(const Candidate *a, const Candidate *b);
+static int dominates(const Candidate *a, const Candidate *b);
+static int nextLaps(int scenario, int laps);
+static const Candidate *writeScenario(FILE *out, const Search *search, const Candidate *base);
+static void usage(void);
+
+int main(int argc, char *argv[])
+{
+    Search search;
+    FILE *out;
+    const char *header = "TunedParams.h";
+    const Candidate *chosen;
+    int scenario = -1, seeds = 8, budget = 120, i, s, laps, p;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for(i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "-s") && i + 1 < argc){
+            scenario = simScenarioFind(argv[++i]);
+            if(scenario < 0)
+                usage();
+        }
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            seeds = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-j") && i + 1 < argc)
+            jobs = atol(argv[++i]);
+        else if(!strcmp(argv[i], "-b") && i + 1 < argc)
+            budget = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-o") && i + 1 < argc)
+            header = argv[++i];
+        else
+            usage();
+    }
+    if(seeds < 1 || budget < 1)
+        usage();
+    if(jobs < 1)
+        jobs = 1;
+
+    out = fopen(header, "w");
+    if(!out){
+        perror(header);
+        return 1;
+    }
+
+    fprintf(out, "/*****************************************************************\n"
+                 "* Module name: TunedParams\n"
+                 "*\n"
+                 "* Generated by host/autotune, do not edit by hand.\n"
+                 "*\n"
+                 "* Module Description:\n"
+                 "* -------------------\n"
+                 "* Timing constants found by searching the simulated benchmarks,\n"
+                 "* %d seeds per candidate. Build a module with -DUSE_TUNED_PARAMS\n"
+                 "* to use them. Anything not listed keeps the module default.\n"
+                 "*\n"
+                 "*****************************************************************/\n\n"
+                 "#ifndef TUNED_PARAMS_H\n#define TUNED_PARAMS_H\n", seeds);
+
+    for(s = 0; s < SIM_SCENARIOS; s++){
+        SimConfig cfg;
+
+        if(scenario >= 0 && s != scenario)
+            continue;
+
+        // each scenario starts from the defaults, the workers inherit simTunable
+        simTunablesReset();
+
+        // a search for each number of laps the scenario's constants need, fewest first
+        for(laps = 1; laps > 0; laps = nextLaps(s, laps)){
+            memset(&search, 0, sizeof(search));
+            search.scenario = s;
+            search.laps = laps;
+            search.seeds = seeds;
+            search.jobs = (int)jobs;
+            simConfigDefaults(&cfg, s);
+            search.limitS = cfg.limitS * laps;
+            for(i = 0; i < TUN_COUNT; i++)
+                if(!strcmp(simTunableInfo[i].scenario, simScenarioName(s)) && simTunableInfo[i].laps == laps)
+                    search.params[search.nParams++] = i;
+            if(!search.nParams)
+                continue;
+
+            search.maxAll = budget;
+            search.all = calloc(search.maxAll, sizeof(Candidate));
+
+            tuneScenario(&search, budget);
+            chosen = writeScenario(out, &search, &search.all[0]);
+            fflush(out);
+
+            // later laps are searched with these as found
+            for(p = 0; p < search.nParams; p++)
+                simTunable[search.params[p]] = chosen->value[p];
+            free(search.all);
+        }
+    }
+
+    fprintf(out, "\n#endif\n");
+    fclose(out);
+    printf("autotune: wrote %s\n", header);
+    return 0;
+}
+
+/*******************************************************************************
+ * Function Name        : tuneScenario
+ *    Returns           : void
+ *    Parameter         : search for one scenario, evaluation budget
+ * Description          : Hand tuned defaults first so everything can be
+ *                        compared to them, then the grid, then refinement.
+ *******************************************************************************/
+static void tuneScenario(Search *search, int budget)
+{
+    Candidate batch[64], best, c;
+    double step[MAX_PARAMS], range;
+    long gridSize = 1, g, pick, idx;
+    int i, p, n, gridBudget, improved, refining;
+    uint32_t shuffle = 12345;
+
+    // defaults are always candidate 0
+    memset(&c, 0, sizeof(c));
+    for(p = 0; p < search->nParams; p++)
+        c.value[p] = simTunableInfo[search->params[p]].def;
+    evaluate(search, &c, 1);
+
+    // coarse grid, levels at 1/6, 1/2 and 5/6 of each range
+    for(p = 0; p < search->nParams && gridSize <= 1000000; p++)
+        gridSize *= GRID_LEVELS;
+    gridBudget = budget / 2;
+
+    for(g = 0, n = 0; g < gridSize && search->nAll < gridBudget && g < (long)gridBudget * 4; g++){
+        // walk the whole grid if it fits, otherwise a repeatable random sample of it
+        if(gridSize <= gridBudget)
+            pick = g;
+        else{
+            shuffle = shuffle * 1103515245u + 12345u;
+            pick = (long)((shuffle >> 4) % (uint32_t)gridSize);
+        }
+
+        memset(&c, 0, sizeof(c));
+        for(p = 0, idx = pick; p < search->nParams; p++, idx /= GRID_LEVELS){
+            const SimTunableInfo *info = &simTunableInfo[search->params[p]];
+
+            range = info->max - info->min;
+            c.value[p] = info->min + lround(range * (2 * (idx % GRID_LEVELS) + 1) / (2.0 * GRID_LEVELS));
+        }
+        clampCandidate(search, &c);
+        if(seen(search, &c))
+            continue;
+        for(i = 0; i < n; i++)
+            if(!memcmp(batch[i].value, c.value, sizeof(c.value)))
+                break;
+        if(i < n)
+            continue;
+
+        batch[n++] = c;
+        if(n == (int)(sizeof(batch) / sizeof(batch[0])) || search->nAll + n >= gridBudget){
+            evaluate(search, batch, n);
+            n = 0;
+        }
+    }
+    if(n)
+        evaluate(search, batch, n);
+
+    // pattern search from the best so far
+    best = search->all[0];
+    for(i = 1; i < search->nAll; i++)
+        if(better(&search->all[i], &best))
+            best = search->all[i];
+
+    for(p = 0; p < search->nParams; p++){
+        const SimTunableInfo *info = &simTunableInfo[search->params[p]];
+
+        step[p] = (info->max - info->min) / (2.0 * GRID_LEVELS);
+        if(step[p] < info->step)
+            step[p] = info->step;
+    }
+
+    refining = 1;
+    while(refining && search->nAll < search->maxAll){
+        n = 0;
+        for(p = 0; p < search->nParams && n + 2 <= (int)(sizeof(batch) / sizeof(batch[0])); p++){
+            for(i = -1; i <= 1; i += 2){
+                c = best;
+                c.done = 0;
+                c.value[p] += lround(i * step[p]);
+                clampCandidate(search, &c);
+                if(!seen(search, &c) && memcmp(c.value, best.value, sizeof(c.value)) && search->nAll + n < search->maxAll)
+                    batch[n++] = c;
+            }
+        }
+
+        if(n)
+            evaluate(search, batch, n);
+
+        improved = 0;
+        for(i = 0; i < n; i++){
+            if(better(&batch[i], &best)){
+                best = batch[i];
+                improved = 1;
+            }
+        }
+
+        // no better neighbour, look closer
+        if(!improved){
+            refining = 0;
+            for(p = 0; p < search->nParams; p++){
+                const SimTunableInfo *info = &simTunableInfo[search->params[p]];
+
+                step[p] /= 2;
+                if(step[p] < info->step)
+                    step[p] = info->step;   // its neighbours are as close as it goes
+                else if(step[p] >= (info->max - info->min) / 100.0 && step[p] >= 1)
+                    refining = 1;
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+ * Function Name        : evaluate
+ *    Returns           : void
+ *    Parameter         : search, candidates to run, how many
+ * Description          : Runs the candidates in forked workers, search->jobs at
+ *                        a time, each sending its scores back down a pipe.
+ *                        Results are added to search->all.
+ *******************************************************************************/
+static void evaluate(Search *search, Candidate *batch, int n)
+{
+    int fds[64], running = 0, next = 0, i, status;
+    pid_t pids[64], pid;
+    int pipefd[2];
+
+    fflush(stdout);
+
+    while(next < n || running){
+        while(next < n && running < search->jobs){
+            if(pipe(pipefd) < 0){
+                perror("autotune: pipe");
+                exit(1);
+            }
+            pid = fork();
+            if(pid < 0){
+                perror("autotune: fork");
+                exit(1);
+            }
+            if(pid == 0){
+                close(pipefd[0]);
+                runCandidate(search, &batch[next]);
+                if(write(pipefd[1], &batch[next], sizeof(Candidate)) != sizeof(Candidate))
+                    _exit(1);
+                _exit(0);
+            }
+            close(pipefd[1]);
+            pids[next] = pid;
+            fds[next] = pipefd[0];
+            next++;
+            running++;
+        }
+
+        pid = waitpid(-1, &status, 0);
+        if(pid < 0){
+            if(errno == EINTR)
+                continue;
+            perror("autotune: waitpid");
+            exit(1);
+        }
+        for(i = 0; i < next; i++){
+            if(pids[i] != pid)
+                continue;
+            if(read(fds[i], &batch[i], sizeof(Candidate)) != sizeof(Candidate) || !batch[i].done){
+                fprintf(stderr, "autotune: worker failed\n");
+                exit(1);
+            }
+            close(fds[i]);
+            running--;
+            break;
+        }
+    }
+
+    for(i = 0; i < n && search->nAll < search->maxAll; i++){
+        search->all[search->nAll++] = batch[i];
+        printf("%-7s %4d  score %7.2fs  ok mean %7.2fs  failed %3.0f%%\n", simScenarioName(search->scenario),
+               search->nAll, batch[i].score, batch[i].meanOk, batch[i].failRate * 100);
+    }
+}
+
+// worker side, runs every seed with the candidate's settings
+static void runCandidate(const Search *search, Candidate *c)
+{
+    SimConfig cfg;
+    SimResult result;
+    double okTotal = 0, total = 0;
+    int seed, ok = 0, p;
+
+    // the rest stay as the parent left them
+    for(p = 0; p < search->nParams; p++)
+        simTunable[search->params[p]] = c->value[p];
+
+    for(seed = 1; seed <= search->seeds; seed++){
+        simConfigDefaults(&cfg, search->scenario);
+        cfg.seed = seed;
+        cfg.laps = search->laps;
+        cfg.limitS = search->limitS;
+        if(simRun(&cfg, &result) < 0)
+            _exit(1);
+        total += result.timeS;
+        if(result.success){
+            ok++;
+            okTotal += result.timeS;
+        }
+    }
+
+    c->meanOk = ok ? okTotal / ok : search->limitS;
+    c->failRate = 1.0 - (double)ok / search->seeds;
+    c->score = total / search->seeds;
+    c->done = 1;
+}
+
+static int seen(const Search *search, const Candidate *c)
+{
+    int i;
+
+    for(i = 0; i < search->nAll; i++)
+        if(!memcmp(search->all[i].value, c->value, sizeof(c->value)))
+            return 1;
+    return 0;
+}
+
+static void clampCandidate(const Search *search, Candidate *c)
+{
+    int p;
+
+    for(p = 0; p < search->nParams; p++){
+        const SimTunableInfo *info = &simTunableInfo[search->params[p]];
+
+        if(info->step)
+            c->value[p] = info->min + lround((double)(c->value[p] - info->min) / info->step) * info->step;
+        if(c->value[p] < info->min)
+            c->value[p] = info->min;
+        if(c->value[p] > info->max)
+            c->value[p] = info->max;
+    }
+}
+
+static int better(const Candidate *a, const Candidate *b)
+{
+    return a->score < b->score;
+}
+
+// a is at least as good on both and strictly better on one
+static int dominates(const Candidate *a, const Candidate *b)
+{
+    return a->meanOk <= b->meanOk && a->failRate <= b->failRate &&
+           (a->meanOk < b->meanOk || a->failRate < b->failRate);
+}
+
+/*******************************************************************************
+ * Function Name        : writeScenario
+ *    Returns           : void
+ *    Parameter         : header being written, finished search, defaults
+ * Description          : Pareto front as comments, chosen point as defines
+ *******************************************************************************/
+static const Candidate *writeScenario(FILE *out, const Search *search, const Candidate *base)
+{
+    const Candidate *front[MAX_FRONT], *chosen = NULL;
+    int nFront = 0, i, j, p, dominated;
+
+    for(i = 0; i < search->nAll; i++){
+        dominated = 0;
+        for(j = 0; j < search->nAll && !dominated; j++)
+            dominated = dominates(&search->all[j], &search->all[i]);
+        if(dominated)
+            continue;
+        if(!chosen || better(&search->all[i], chosen))
+            chosen = &search->all[i];
+        if(nFront < MAX_FRONT)
+            front[nFront++] = &search->all[i];
+    }
+
+    fprintf(out, "\n/* %s, %d lap%s - %d candidates\n *   hand tuned: mean %.2fs, %.0f%% failed\n"
+                 " *   Pareto front (mean of finished runs, failed):\n", simScenarioName(search->scenario),
+            search->laps, search->laps == 1 ? "" : "s", search->nAll, base->meanOk, base->failRate * 100);
+    fprintf(out, " *                   ");
+    for(p = 0; p < search->nParams; p++)
+        fprintf(out, " %s", simTunableInfo[search->params[p]].name);
+    fprintf(out, "\n");
+    for(i = 0; i < nFront; i++){
+        fprintf(out, " *     %7.2fs %3.0f%% ", front[i]->meanOk, front[i]->failRate * 100);
+        for(p = 0; p < search->nParams; p++)
+            fprintf(out, " %ld", front[i]->value[p]);
+        fprintf(out, "%s\n", front[i] == chosen ? "  <- used" : "");
+    }
+    fprintf(out, " */\n");
+
+    for(p = 0; p < search->nParams; p++)
+        fprintf(out, "#define %-24s %ld\n", simTunableInfo[search->params[p]].name, chosen->value[p]);
+    return chosen;
+}
+
+// fewest laps over laps any of the scenario's constants need, 0 if none
+static int nextLaps(int scenario, int laps)
+{
+    int next = 0, i;
+
+    for(i = 0; i < TUN_COUNT; i++)
+        if(!strcmp(simTunableInfo[i].scenario, simScenarioName(scenario)) && simTunableInfo[i].laps > laps &&
+           (!next || simTunableInfo[i].laps < next))
+            next = simTunableInfo[i].laps;
+    return next;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: autotune [-s line|light|escape|obstacle] [-n seeds] [-j jobs] [-b budget] [-o header]\n");
+    exit(1);
+}
@@ -0,0 +1,391 @@
+/*******************************************************************************
+ * Program Name         : bench.c
+ * Project              : Marco Robot Coursework - host tools
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Runs the simulated benchmarks and prints how long
+ *                        each module takes over a number of seeded runs.
+ *
+ *                        Usage: bench [-s line|light|escape|obstacle] [-n runs]
+ *                                     [-S first_seed] [-l laps]
+ *                                     [-t telemetry_file] [-r recording_file]
+ *                                     [-v battery_mv] [-e] [-D]
+ *                                     [-f FAULT=LEVEL]... [-p NAME=VALUE]...
+ *                                     [-o results_file] [-b baseline_file]
+ *
+ *                        Without -s every scenario is run. -p overrides a
+ *                        tuning constant (see sim/tunables.def) for the run.
+ *                        -t keeps the JTAG UART bytes of the last run so they
+ *                        can be checked with telemdec, -r keeps its input
+ *                        recording so it can be run again with replay.
+ *                        -v starts each run with the pack at that voltage.
+ *                        -e adds a second table from each module's own motor
+ *                        accounting (see ControlStats in Control.h): share of
+ *                        the run each wheel was on, how much of that was in
+ *                        reverse, reversals a run, why the motors were off,
+ *                        and the energy estimate per run and per metre.
+ *                        -f turns on a hardware fault in the simulated robot
+ *                        (flicker, bounce, adc, step or asym, see SimFaults in
+ *                        sim/sim.h). -D adds a table of how each scenario
+ *                        degrades as each fault is raised in turn.
+ *                        -o keeps every run in a results file (see results.h),
+ *                        -b compares this bench with one kept earlier and
+ *                        says per scenario whether it is significantly faster
+ *                        or slower. Exits 2 if any scenario got slower. A
+ *                        baseline run on another -v or -f is refused, one
+ *                        with other -p values is compared and the values
+ *                        that differ are listed.
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim/sim.h"
+#include "results.h"
+
+/* ControlStats summed over a scenario's runs */
+typedef struct
+{
+    int runs;
+    double ticks, leftOn, rightOn, reverse, reversals;
+    double stop, safety, dutyOff, energyJ, distanceM;
+} Energy;
+
+/* what every run of a batch shares */
+typedef struct
+{
+    int runs, laps;
+    uint32_t firstSeed;
+    const char *telemetry, *recording;
+    double batteryMv;
+    SimFaults faults;
+} Batch;
+
+/* levels -D tries, in simFaultName() order */
+static const double sweepLevels[][3] = {
+    { 0.5, 2, 8 },              // flicker, a second
+    { 2, 5, 20 },               // bounce, ms
+    { 0.01, 0.05, 0.2 },        // adc, chance a conversion
+    { 0.01, 0.05, 0.2 },        // step, chance a step
+    { 0.05, 0.1, 0.2 },         // asym, right over left
+};
+
+#define SWEEP_LEVELS 3
+
+static int runBatch(const Batch *batch, int scenario, double *times, int *ok, double *mean, Energy *energy,
+                    ScenarioResults *keep);
+static int compareBaseline(const Results *results, const char *file);
+static int sweep(const Batch *batch, int scenario, double *times);
+static void addEnergy(Energy *e, const SimResult *result);
+static void printEnergy(int scenario, const Energy *e);
+static void usage(void);
+
+int main(int argc, char *argv[])
+{
+    Batch batch;
+    Energy energy[SIM_SCENARIOS];
+    Results results;
+    const char *resultsFile = NULL, *baselineFile = NULL;
+    int scenario = -1, showEnergy = 0, showSweep = 0, status = 0, i, s, ok, t;
+    double *times, mean;
+    char *eq;
+
+    simTunablesReset();
+
+    memset(&batch, 0, sizeof(batch));
+    batch.runs = 10;
+    batch.laps = 1;
+    batch.firstSeed = 1;
+    batch.batteryMv = SIM_BATTERY_NOMINAL_MV;
+
+    for(i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "-s") && i + 1 < argc){
+            scenario = simScenarioFind(argv[++i]);
+            if(scenario < 0)
+                usage();
+        }
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            batch.runs = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-S") && i + 1 < argc)
+            batch.firstSeed = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if(!strcmp(argv[i], "-l") && i + 1 < argc)
+            batch.laps = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-t") && i + 1 < argc)
+            batch.telemetry = argv[++i];
+        else if(!strcmp(argv[i], "-r") && i + 1 < argc)
+            batch.recording = argv[++i];
+        else if(!strcmp(argv[i], "-v") && i + 1 < argc)
+            batch.batteryMv = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-e"))
+            showEnergy = 1;
+        else if(!strcmp(argv[i], "-D"))
+            showSweep = 1;
+        else if(!strcmp(argv[i], "-o") && i + 1 < argc)
+            resultsFile = argv[++i];
+        else if(!strcmp(argv[i], "-b") && i + 1 < argc)
+            baselineFile = argv[++i];
+        else if(!strcmp(argv[i], "-f") && i + 1 < argc){
+            eq = strchr(argv[++i], '=');
+            if(!eq)
+                usage();
+            *eq = '\0';
+            if(simFaultSet(&batch.faults, argv[i], atof(eq + 1)) < 0){
+                fprintf(stderr, "bench: no fault called %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "-p") && i + 1 < argc){
+            eq = strchr(argv[++i], '=');
+            if(!eq)
+                usage();
+            *eq = '\0';
+            t = simTunableFind(argv[i]);
+            if(t < 0){
+                fprintf(stderr, "bench: no tunable called %s\n", argv[i]);
+                return 1;
+            }
+            simTunable[t] = atol(eq + 1);
+        }
+        else
+            usage();
+    }
+    if(batch.runs < 1)
+        usage();
+
+    times = malloc(batch.runs * sizeof(double));
+    memset(energy, 0, sizeof(energy));
+    resultsInit(&results);
+    results.batteryMv = batch.batteryMv;
+    results.faults = batch.faults;
+    memcpy(results.tunable, simTunable, sizeof(results.tunable));
+
+    printf("%-8s %5s %5s %9s %9s %9s %9s\n", "scenario", "runs", "ok", "mean_s", "p50_s", "p90_s", "max_s");
+
+    for(s = 0; s < SIM_SCENARIOS; s++){
+        if(scenario >= 0 && s != scenario)
+            continue;
+
+        results.scenario[s].scenario = s;
+        results.scenario[s].laps = batch.laps;
+        if(runBatch(&batch, s, times, &ok, &mean, &energy[s], &results.scenario[s]) < 0)
+            return 1;
+        printf("%-8s %5d %5d %9.2f %9.2f %9.2f %9.2f\n", simScenarioName(s), batch.runs, ok, mean,
+               simPercentile(times, batch.runs, 50), simPercentile(times, batch.runs, 90), times[batch.runs - 1]);
+    }
+
+    if(showEnergy){
+        printf("\n%-8s %6s %6s %6s %7s %6s %6s %6s %9s %8s\n", "scenario", "onL%", "onR%", "rev%",
+               "revs", "stop%", "safe%", "duty%", "energy_J", "J_per_m");
+        for(s = 0; s < SIM_SCENARIOS; s++)
+            if(energy[s].runs)
+                printEnergy(s, &energy[s]);
+    }
+
+    if(showSweep && sweep(&batch, scenario, times) < 0)
+        return 1;
+
+    if(resultsFile && resultsWrite(&results, resultsFile) < 0)
+        return 1;
+    if(baselineFile){
+        status = compareBaseline(&results, baselineFile);
+        if(status < 0)
+            return 1;
+    }
+
+    resultsFree(&results);
+    free(times);
+    return status;
+}
+
+/*******************************************************************************
+ * Function Name        : runBatch
+ *    Returns           : 0, or -1 if the module would not load
+ *    Parameter         : batch settings, scenario, times filled in sorted,
+ *                        runs that finished, mean time, energy added to,
+ *                        results to keep the runs in or NULL
+ * Description          : Runs the scenario once for each seed. The telemetry
+ *                        and recording, if asked for, come from the last run.
+ *******************************************************************************/
+static int runBatch(const Batch *batch, int scenario, double *times, int *ok, double *mean, Energy *energy,
+                    ScenarioResults *keep)
+{
+    SimConfig cfg;
+    SimResult result;
+    double total = 0;
+    int i;
+
+    *ok = 0;
+    for(i = 0; i < batch->runs; i++){
+        simConfigDefaults(&cfg, scenario);
+        cfg.seed = batch->firstSeed + i;
+        cfg.laps = batch->laps;
+        cfg.telemetry = (i == batch->runs - 1) ? batch->telemetry : NULL;
+        cfg.recording = (i == batch->runs - 1) ? batch->recording : NULL;
+        cfg.batteryMv = batch->batteryMv;
+        cfg.faults = batch->faults;
+        if(simRun(&cfg, &result) < 0)
+            return -1;
+        // failed runs count as the time limit so they always look slow
+        times[i] = result.timeS;
+        total += result.timeS;
+        *ok += result.success;
+        addEnergy(energy, &result);
+        if(keep)
+            resultsAdd(keep, cfg.seed, &result);
+    }
+
+    simSort(times, batch->runs);
+    *mean = total / batch->runs;
+    return 0;
+}
+
+/*******************************************************************************
+ * Function Name        : sweep
+ *    Returns           : 0, or -1 if a module would not load
+ *    Parameter         : batch settings, scenario or -1 for all, space for
+ *                        the times
+ * Description          : Degradation table. Each fault is raised through
+ *                        sweepLevels on its own, on top of any -f faults,
+ *                        and every scenario is run again at each level
+ *******************************************************************************/
+static int sweep(const Batch *batch, int scenario, double *times)
+{
+    Batch faulty;
+    Energy energy;
+    const char *name;
+    double mean;
+    int f, level, s, ok;
+
+    printf("\n%-8s %6s", "fault", "level");
+    for(s = 0; s < SIM_SCENARIOS; s++)
+        if(scenario < 0 || s == scenario)
+            printf(" %8s_ok %9s_s", simScenarioName(s), simScenarioName(s));
+    printf("\n");
+
+    for(f = -1; f < 0 || simFaultName(f); f++){
+        for(level = 0; level < (f < 0 ? 1 : SWEEP_LEVELS); level++){
+            faulty = *batch;
+            faulty.telemetry = NULL;
+            faulty.recording = NULL;
+            name = f < 0 ? "none" : simFaultName(f);
+            if(f >= 0)
+                simFaultSet(&faulty.faults, name, sweepLevels[f][level]);
+
+            printf("%-8s %6g", name, f < 0 ? 0.0 : sweepLevels[f][level]);
+            for(s = 0; s < SIM_SCENARIOS; s++){
+                if(scenario >= 0 && s != scenario)
+                    continue;
+                memset(&energy, 0, sizeof(energy));
+                if(runBatch(&faulty, s, times, &ok, &mean, &energy, NULL) < 0)
+                    return -1;
+                printf(" %11d %11.2f", ok, mean);
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
+
+/*******************************************************************************
+ * Function Name        : compareBaseline
+ *    Returns           : 2 if a scenario is significantly slower, 0 if not,
+ *                        -1 if the baseline could not be read or was run
+ *                        on another battery or with other faults
+ *    Parameter         : results of this bench, baseline results file
+ * Description          : Prints each scenario run in both against the
+ *                        baseline with the confidence interval of the change.
+ *                        Tunables that differ are listed first, as they are
+ *                        usually what is being compared.
+ *******************************************************************************/
+static int compareBaseline(const Results *results, const char *file)
+{
+    static const char *verdicts[] = { "same", "faster", "SLOWER" };
+    Results baseline;
+    Comparison c;
+    const ScenarioResults *base, *now;
+    int s, i, status = 0;
+
+    if(resultsRead(&baseline, file) < 0)
+        return -1;
+
+    if(baseline.batteryMv != results->batteryMv){
+        fprintf(stderr, "%s: battery %.0fmV against %.0fmV, not compared\n", file, baseline.batteryMv,
+                results->batteryMv);
+        status = -1;
+    }
+    for(i = 0; simFaultName(i); i++)
+        if(simFaultLevel(&baseline.faults, i) != simFaultLevel(&results->faults, i)){
+            fprintf(stderr, "%s: fault %s %g against %g, not compared\n", file, simFaultName(i),
+                    simFaultLevel(&baseline.faults, i), simFaultLevel(&results->faults, i));
+            status = -1;
+        }
+    if(status < 0){
+        resultsFree(&baseline);
+        return -1;
+    }
+
+    printf("\nagainst %s, %d%% bootstrap intervals\n", file, RESULTS_CONFIDENCE);
+    for(i = 0; i < TUN_COUNT; i++)
+        if(baseline.tunable[i] != results->tunable[i])
+            printf("tunable %s %ld against %ld\n", simTunableInfo[i].name, baseline.tunable[i], results->tunable[i]);
+    printf("%-8s %9s %9s %8s %19s %7s  %s\n", "scenario", "base_s", "new_s", "diff_s", "interval_s", "ok", "verdict");
+    for(s = 0; s < SIM_SCENARIOS; s++){
+        base = &baseline.scenario[s];
+        now = &results->scenario[s];
+        if(base->runs == 0 || now->runs == 0)
+            continue;
+        if(base->laps != now->laps){
+            printf("%-8s laps differ (%d against %d), not compared\n", simScenarioName(s), base->laps, now->laps);
+            continue;
+        }
+
+        resultsCompare(base, now, &c);
+        printf("%-8s %9.2f %9.2f %+8.2f    [%+6.2f, %+6.2f] %3d/%-3d  %s%s\n", simScenarioName(s), c.baseMean,
+               c.newMean, c.diff, c.low, c.high, now->ok, base->ok, verdicts[c.verdict],
+               c.paired ? "" : " (seeds differ, unpaired)");
+        if(c.verdict == RESULTS_SLOWER)
+            status = 2;
+    }
+
+    resultsFree(&baseline);
+    return status;
+}
+
+static void addEnergy(Energy *e, const SimResult *result)
+{
+    const ControlStats *c = &result->control;
+
+    e->runs++;
+    e->ticks += c->ticks;
+    e->leftOn += (double)c->left.forwardTicks + c->left.reverseTicks;
+    e->rightOn += (double)c->right.forwardTicks + c->right.reverseTicks;
+    e->reverse += (double)c->left.reverseTicks + c->right.reverseTicks;
+    e->reversals += (double)c->left.reversals + c->right.reversals;
+    e->stop += c->stopTicks;
+    e->safety += c->safetyTicks;
+    e->dutyOff += c->dutyOffTicks;
+    e->energyJ += c->energyMj * 1e-3;
+    e->distanceM += result->distanceM;
+}
+
+// percentages are of all ticks, except rev% which is of the wheels' on ticks
+static void printEnergy(int scenario, const Energy *e)
+{
+    double ticks = e->ticks > 0 ? e->ticks : 1, on = e->leftOn + e->rightOn;
+
+    printf("%-8s %6.1f %6.1f %6.1f %7.1f %6.1f %6.1f %6.1f %9.2f %8.2f\n", simScenarioName(scenario),
+           100 * e->leftOn / ticks, 100 * e->rightOn / ticks, on > 0 ? 100 * e->reverse / on : 0.0,
+           e->reversals / e->runs, 100 * e->stop / ticks, 100 * e->safety / ticks, 100 * e->dutyOff / ticks,
+           e->energyJ / e->runs, e->distanceM > 0 ? e->energyJ / e->distanceM : 0.0);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: bench [-s line|light|escape|obstacle] [-n runs] [-S first_seed] [-l laps]\n"
+                    "             [-t telemetry_file] [-r recording_file]\n"
+                    "             [-v battery_mv] [-e] [-D] [-f FAULT=LEVEL]... [-p NAME=VALUE]...\n"
+                    "             [-o results_file] [-b baseline_file]\n");
+    exit(1);
+}
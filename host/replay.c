@@ -0,0 +1,232 @@
+/*******************************************************************************
+ * Program Name         : replay.c
+ * Project              : Marco Robot Coursework - host tools
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Runs a module against a recording made by Recorder,
+ *                        on the robot or with bench -r, and checks it gives
+ *                        every motor and stepper command it gave at the time.
+ *                        The module is built with RECORDER_REPLAY so each
+ *                        input it reads comes out of the recording and no
+ *                        robot or world is needed, which makes a replay far
+ *                        faster than the run was.
+ *
+ *                        Usage: replay -s line|light|escape|obstacle [-n passes]
+ *                                      [-p NAME=VALUE]... recording_file
+ *
+ *                        -p must give the same tuning constants the run was
+ *                        recorded with. -n replays the recording that many
+ *                        times to get a steadier speed figure. Exits 0 if the
+ *                        whole recording replayed, 1 if the module went a
+ *                        different way.
+ *******************************************************************************/
+
+#include <dlfcn.h>
+#include <libgen.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim/tunables.h"
+#include "Recorder.h"
+#include "Control.h"
+
+/* replay build of each scenario's module, next to the executable */
+static const char *scenarioNames[] = { "line", "light", "escape", "obstacle" };
+static const char *moduleFiles[] = { "line-replay.so", "light-replay.so", "escape-replay.so", "line-replay.so" };
+
+#define SCENARIOS ((int)(sizeof(scenarioNames) / sizeof(scenarioNames[0])))
+
+typedef struct
+{
+    int reason;                 // REPLAY_END or REPLAY_DIVERGED
+    unsigned long commands;
+    unsigned long ticks;
+    unsigned long offset;       // bytes of the recording used
+} Outcome;
+
+static jmp_buf stopped;
+static int stopReason;
+
+static int replayOnce(const char *path, const Recording *file, size_t size, Outcome *outcome);
+static void besideExe(const char *file, char *path, size_t size);
+static double seconds(void);
+static void usage(void);
+
+int main(int argc, char *argv[])
+{
+    char path[PATH_MAX];
+    Recording *file;
+    Outcome outcome;
+    FILE *in;
+    size_t size;
+    int scenario = -1, passes = 1, i, t;
+    const char *name = NULL;
+    double start, taken, recorded;
+    char *eq;
+
+    for(i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "-s") && i + 1 < argc){
+            i++;
+            for(scenario = SCENARIOS - 1; scenario >= 0; scenario--)
+                if(!strcmp(scenarioNames[scenario], argv[i]))
+                    break;
+            if(scenario < 0)
+                usage();
+        }
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            passes = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-p") && i + 1 < argc){
+            eq = strchr(argv[++i], '=');
+            if(!eq)
+                usage();
+            *eq = '\0';
+            t = simTunableFind(argv[i]);
+            if(t < 0){
+                fprintf(stderr, "replay: no tunable called %s\n", argv[i]);
+                return 1;
+            }
+            simTunable[t] = atol(eq + 1);
+        }
+        else if(argv[i][0] != '-' && !name)
+            name = argv[i];
+        else
+            usage();
+    }
+    if(scenario < 0 || !name || passes < 1)
+        usage();
+
+    file = calloc(1, sizeof(*file));
+    in = fopen(name, "rb");
+    if(!in){
+        perror(name);
+        return 1;
+    }
+    size = fread(file, 1, sizeof(*file), in);
+    fclose(in);
+
+    if(size < offsetof(Recording, data) || file->magic != RECORD_MAGIC ||
+       file->used != size - offsetof(Recording, data)){
+        fprintf(stderr, "replay: %s is not a whole recording\n", name);
+        return 1;
+    }
+
+    besideExe(moduleFiles[scenario], path, sizeof(path));
+
+    start = seconds();
+    for(i = 0; i < passes; i++)
+        if(replayOnce(path, file, size, &outcome) < 0)
+            return 1;
+    taken = (seconds() - start) / passes;
+
+    recorded = outcome.ticks * (CONTROL_TICK_US * 1e-6);
+
+    printf("recording : %s, %s, %lu bytes%s\n", name, scenarioNames[scenario],
+           (unsigned long)file->used, file->full ? " (filled up)" : "");
+    if(outcome.reason == REPLAY_END)
+        printf("result    : same all the way through\n");
+    else
+        printf("result    : diverged at byte %lu\n", outcome.offset);
+    printf("commands  : %lu matched\n", outcome.commands);
+    printf("covers    : %.3f s of the run\n", recorded);
+    printf("replay    : %.4f s a pass, %.0fx real time\n", taken,
+           taken > 0 ? recorded / taken : 0.0);
+
+    free(file);
+    return outcome.reason == REPLAY_END ? 0 : 1;
+}
+
+/*******************************************************************************
+ * Function Name        : replayOnce
+ *    Returns           : 0, or -1 if the module would not load
+ *    Parameter         : module path, recording and its size, outcome filled in
+ * Description          : Loads the module fresh so none of its static state
+ *                        carries over, puts the recording in its buffer and
+ *                        runs it until the recording says stop
+ *******************************************************************************/
+static int replayOnce(const char *path, const Recording *file, size_t size, Outcome *outcome)
+{
+    void *module;
+    Recording *recording;
+    int (*entry)(void);
+    alt_u32 (*commands)(void);
+    alt_u32 (*ticks)(void);
+    alt_u32 (*offset)(void);
+
+    module = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if(!module){
+        fprintf(stderr, "replay: %s\n", dlerror());
+        return -1;
+    }
+    recording = dlsym(module, "recording");
+    entry = (int (*)(void))dlsym(module, "robot_main");
+    commands = (alt_u32 (*)(void))dlsym(module, "recorderReplayCommands");
+    ticks = (alt_u32 (*)(void))dlsym(module, "recorderReplayTicks");
+    offset = (alt_u32 (*)(void))dlsym(module, "recorderReplayOffset");
+    if(!recording || !entry || !commands || !ticks || !offset){
+        fprintf(stderr, "replay: %s was not built for replay\n", path);
+        dlclose(module);
+        return -1;
+    }
+    memcpy(recording, file, size);
+
+    if(!setjmp(stopped)){
+        entry();
+        // main returning with recording left over went another way
+        stopReason = (offset() < recording->used) ? REPLAY_DIVERGED : REPLAY_END;
+    }
+
+    outcome->reason = stopReason;
+    outcome->commands = commands();
+    outcome->ticks = ticks();
+    outcome->offset = offset();
+
+    dlclose(module);
+    return 0;
+}
+
+/*******************************************************************************
+ * Function Name        : recorderReplayEnd
+ *    Returns           : never
+ *    Parameter         : REPLAY_END or REPLAY_DIVERGED
+ * Description          : Called from inside the module when the replay stops,
+ *                        unwinds straight back out of it to replayOnce
+ *******************************************************************************/
+void recorderReplayEnd(alt_u8 reason)
+{
+    stopReason = reason;
+    longjmp(stopped, 1);
+}
+
+// path of a file sitting beside the running executable
+static void besideExe(const char *file, char *path, size_t size)
+{
+    char exe[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+
+    if(n <= 0){
+        snprintf(path, size, "./%s", file);
+        return;
+    }
+    exe[n] = '\0';
+    snprintf(path, size, "%s/%s", dirname(exe), file);
+}
+
+static double seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: replay -s line|light|escape|obstacle [-n passes] [-p NAME=VALUE]... recording_file\n");
+    exit(1);
+}
@@ -0,0 +1,290 @@
+/*******************************************************************************
+ * Program Name         : results.c
+ * Project              : Marco Robot Coursework - host tools
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Reads and writes benchmark result files and compares
+ *                        two sets of runs with a bootstrap confidence interval
+ *                        on the difference of their mean times. See results.h
+ *                        for the file format.
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "results.h"
+
+static double resampledMean(const double *values, int n, uint32_t *rng);
+static uint32_t nextRandom(uint32_t *rng);
+
+void resultsInit(Results *results)
+{
+    int s;
+
+    memset(results, 0, sizeof(*results));
+    results->batteryMv = SIM_BATTERY_NOMINAL_MV;
+    for(s = 0; s < TUN_COUNT; s++)
+        results->tunable[s] = simTunableInfo[s].def;
+    for(s = 0; s < SIM_SCENARIOS; s++)
+        results->scenario[s].scenario = -1;
+}
+
+void resultsFree(Results *results)
+{
+    int s;
+
+    for(s = 0; s < SIM_SCENARIOS; s++){
+        free(results->scenario[s].seeds);
+        free(results->scenario[s].times);
+        free(results->scenario[s].success);
+    }
+    resultsInit(results);
+}
+
+/*******************************************************************************
+ * Function Name        : resultsAdd
+ *    Returns           : void
+ *    Parameter         : scenario's results, seed of the run, its result
+ * Description          : Appends one run, the caller sets scenario and laps
+ *******************************************************************************/
+void resultsAdd(ScenarioResults *s, uint32_t seed, const SimResult *result)
+{
+    int i;
+
+    s->seeds = realloc(s->seeds, (s->runs + 1) * sizeof(*s->seeds));
+    s->times = realloc(s->times, (s->runs + 1) * sizeof(*s->times));
+    s->success = realloc(s->success, (s->runs + 1) * sizeof(*s->success));
+
+    s->seeds[s->runs] = seed;
+    s->times[s->runs] = result->timeS;
+    s->success[s->runs] = (uint8_t)result->success;
+    s->runs++;
+    s->ok += result->success;
+
+    for(i = 0; i < SIM_LATENCY_BUCKETS; i++)
+        s->latency[i] += result->latency[i];
+}
+
+/*******************************************************************************
+ * Function Name        : resultsWrite
+ *    Returns           : 0, or -1 if the file could not be written
+ *    Parameter         : results, file to write
+ * Description          : Writes every scenario that has runs. The summary
+ *                        line is for reading by eye, resultsRead works it out
+ *                        again from the runs.
+ *******************************************************************************/
+int resultsWrite(const Results *results, const char *file)
+{
+    const ScenarioResults *r;
+    double *sorted, total;
+    FILE *out;
+    int s, i;
+
+    out = fopen(file, "w");
+    if(!out){
+        perror(file);
+        return -1;
+    }
+
+    fprintf(out, "marco-bench %d\n", RESULTS_VERSION);
+    fprintf(out, "battery %g\n", results->batteryMv);
+    for(i = 0; simFaultName(i); i++)
+        if(simFaultLevel(&results->faults, i) != 0)
+            fprintf(out, "fault %s %g\n", simFaultName(i), simFaultLevel(&results->faults, i));
+    for(i = 0; i < TUN_COUNT; i++)
+        if(results->tunable[i] != simTunableInfo[i].def)
+            fprintf(out, "tunable %s %ld\n", simTunableInfo[i].name, results->tunable[i]);
+    for(s = 0; s < SIM_SCENARIOS; s++){
+        r = &results->scenario[s];
+        if(r->scenario < 0 || r->runs == 0)
+            continue;
+
+        sorted = malloc(r->runs * sizeof(double));
+        memcpy(sorted, r->times, r->runs * sizeof(double));
+        simSort(sorted, r->runs);
+        total = 0;
+        for(i = 0; i < r->runs; i++)
+            total += r->times[i];
+
+        fprintf(out, "scenario %s %d %d %d\n", simScenarioName(s), r->runs, r->ok, r->laps);
+        fprintf(out, "summary %.3f %.3f %.3f %.3f\n", total / r->runs, simPercentile(sorted, r->runs, 50),
+                simPercentile(sorted, r->runs, 90), sorted[r->runs - 1]);
+        for(i = 0; i < r->runs; i++)
+            fprintf(out, "run %u %.6f %d\n", r->seeds[i], r->times[i], r->success[i]);
+        fprintf(out, "latency");
+        for(i = 0; i < SIM_LATENCY_BUCKETS; i++)
+            fprintf(out, " %u", r->latency[i]);
+        fprintf(out, "\nend\n");
+        free(sorted);
+    }
+
+    if(fclose(out) != 0){
+        perror(file);
+        return -1;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+ * Function Name        : resultsRead
+ *    Returns           : 0, or -1 if the file is missing or not understood
+ *    Parameter         : results filled in, file to read
+ * Description          : Reads a file written by resultsWrite. Scenarios this
+ *                        build does not know are skipped, a fault or tunable
+ *                        it does not know refuses the file as its runs
+ *                        cannot be matched.
+ *******************************************************************************/
+int resultsRead(Results *results, const char *file)
+{
+    ScenarioResults *r = NULL, skipped;
+    SimResult run;
+    char line[512], name[64];
+    double level;
+    long value;
+    unsigned seed;
+    int version, runs, ok, laps, success, s, i, n, used;
+    FILE *in;
+
+    resultsInit(results);
+
+    in = fopen(file, "r");
+    if(!in){
+        perror(file);
+        return -1;
+    }
+
+    if(!fgets(line, sizeof(line), in) || sscanf(line, "marco-bench %d", &version) != 1 ||
+       version != RESULTS_VERSION){
+        fprintf(stderr, "%s: not a version %d results file\n", file, RESULTS_VERSION);
+        fclose(in);
+        return -1;
+    }
+
+    memset(&skipped, 0, sizeof(skipped));
+    memset(&run, 0, sizeof(run));
+
+    while(fgets(line, sizeof(line), in)){
+        if(sscanf(line, "battery %lf", &level) == 1)
+            results->batteryMv = level;
+        else if(sscanf(line, "fault %63s %lf", name, &level) == 2){
+            if(simFaultSet(&results->faults, name, level) < 0){
+                fprintf(stderr, "%s: no fault called %s\n", file, name);
+                fclose(in);
+                return -1;
+            }
+        }
+        else if(sscanf(line, "tunable %63s %ld", name, &value) == 2){
+            i = simTunableFind(name);
+            if(i < 0){
+                fprintf(stderr, "%s: no tunable called %s\n", file, name);
+                fclose(in);
+                return -1;
+            }
+            results->tunable[i] = value;
+        }
+        else if(sscanf(line, "scenario %63s %d %d %d", name, &runs, &ok, &laps) == 4){
+            s = simScenarioFind(name);
+            r = (s >= 0) ? &results->scenario[s] : &skipped;
+            r->scenario = s;
+            r->laps = laps;
+        }
+        else if(r && sscanf(line, "run %u %lf %d", &seed, &run.timeS, &success) == 3){
+            run.success = success;
+            if(r != &skipped)
+                resultsAdd(r, seed, &run);
+        }
+        else if(r && !strncmp(line, "latency", 7)){
+            for(i = 0, n = 7; i < SIM_LATENCY_BUCKETS; i++){
+                if(sscanf(line + n, " %u%n", &r->latency[i], &used) != 1)
+                    break;
+                n += used;
+            }
+        }
+        else if(!strncmp(line, "end", 3))
+            r = NULL;
+    }
+
+    fclose(in);
+    return 0;
+}
+
+/*******************************************************************************
+ * Function Name        : resultsCompare
+ *    Returns           : void
+ *    Parameter         : baseline and new runs of one scenario, comparison
+ *                        filled in
+ * Description          : Bootstrap interval on new mean less baseline mean.
+ *                        When both ran the same seeds each seed's difference
+ *                        is resampled, which takes out how hard each start
+ *                        is and needs far fewer runs to see a change.
+ *                        Otherwise the two sets are resampled apart. A
+ *                        change only counts when the whole interval is
+ *                        more than RESULTS_RESOLUTION one side of 0.
+ *******************************************************************************/
+void resultsCompare(const ScenarioResults *base, const ScenarioResults *now, Comparison *out)
+{
+    double *means, *diffs;
+    uint32_t rng = 0x2545F491;  // fixed, so a comparison always says the same
+    double tail = (100.0 - RESULTS_CONFIDENCE) / 2;
+    int i, n;
+
+    memset(out, 0, sizeof(*out));
+    out->baseMean = resampledMean(base->times, base->runs, NULL);
+    out->newMean = resampledMean(now->times, now->runs, NULL);
+    out->diff = out->newMean - out->baseMean;
+
+    out->paired = (base->runs == now->runs);
+    for(i = 0; out->paired && i < base->runs; i++)
+        if(base->seeds[i] != now->seeds[i])
+            out->paired = 0;
+
+    means = malloc(RESULTS_RESAMPLES * sizeof(double));
+    if(out->paired){
+        n = now->runs;
+        diffs = malloc(n * sizeof(double));
+        for(i = 0; i < n; i++)
+            diffs[i] = now->times[i] - base->times[i];
+        for(i = 0; i < RESULTS_RESAMPLES; i++)
+            means[i] = resampledMean(diffs, n, &rng);
+        free(diffs);
+    }
+    else{
+        for(i = 0; i < RESULTS_RESAMPLES; i++)
+            means[i] = resampledMean(now->times, now->runs, &rng) - resampledMean(base->times, base->runs, &rng);
+    }
+
+    simSort(means, RESULTS_RESAMPLES);
+    out->low = simPercentile(means, RESULTS_RESAMPLES, tail);
+    out->high = simPercentile(means, RESULTS_RESAMPLES, 100 - tail);
+    free(means);
+
+    if(out->low > RESULTS_RESOLUTION)
+        out->verdict = RESULTS_SLOWER;
+    else if(out->high < -RESULTS_RESOLUTION)
+        out->verdict = RESULTS_FASTER;
+    else
+        out->verdict = RESULTS_SAME;
+}
+
+// mean of n values drawn with replacement, or of the values themselves without an rng
+static double resampledMean(const double *values, int n, uint32_t *rng)
+{
+    double total = 0;
+    int i;
+
+    if(n <= 0)
+        return 0;
+    for(i = 0; i < n; i++)
+        total += rng ? values[nextRandom(rng) % (uint32_t)n] : values[i];
+    return total / n;
+}
+
+// xorshift32, plenty for resampling
+static uint32_t nextRandom(uint32_t *rng)
+{
+    *rng ^= *rng << 13;
+    *rng ^= *rng >> 17;
+    *rng ^= *rng << 5;
+    return *rng;
+}
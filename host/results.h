@@ -0,0 +1,79 @@
+/*******************************************************************************
+ * Program Name         : results.h
+ * Project              : Marco Robot Coursework - host tools
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Benchmark result files. bench -o keeps every run of
+ *                        every scenario so a later bench -b can compare
+ *                        against it run for run, not just on averages.
+ *
+ *                        The file is text, one item a line:
+ *
+ *                          marco-bench 2
+ *                          battery MV
+ *                          fault NAME LEVEL    (each fault that is on)
+ *                          tunable NAME VALUE  (each set off its default)
+ *                          scenario NAME RUNS OK LAPS
+ *                          summary MEAN P50 P90 MAX
+ *                          run SEED TIME_S SUCCESS
+ *                          latency COUNT...    (SIM_LATENCY_BUCKETS of them)
+ *                          end
+ *
+ *                        with the scenario to end block repeated. The lines
+ *                        before the first scenario are the conditions every
+ *                        run was made under. The number
+ *                        after marco-bench is RESULTS_VERSION, a file with
+ *                        another version is refused rather than misread.
+ *******************************************************************************/
+
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <stdint.h>
+
+#include "sim/sim.h"
+
+#define RESULTS_VERSION     2
+#define RESULTS_CONFIDENCE  95          // percent, of the bootstrap intervals
+#define RESULTS_RESAMPLES   4000
+#define RESULTS_RESOLUTION  0.001       // s, a smaller change is no change
+
+typedef struct
+{
+    int scenario;               // -1 if this slot is not in the file
+    int runs, ok, laps;
+    uint32_t *seeds;
+    double *times;              // failed runs count as the time limit
+    uint8_t *success;
+    uint32_t latency[SIM_LATENCY_BUCKETS];
+} ScenarioResults;
+
+typedef struct
+{
+    double batteryMv;           // conditions of every run, as bench -v, -f and -p
+    SimFaults faults;
+    long tunable[TUN_COUNT];
+    ScenarioResults scenario[SIM_SCENARIOS];
+} Results;
+
+/* how a scenario compares with its baseline */
+typedef struct
+{
+    double baseMean, newMean;
+    double diff, low, high;     // new less base, and its confidence interval
+    int paired;                 // same seeds both sides, compared seed by seed
+    int verdict;                // RESULTS_SAME, _FASTER or _SLOWER
+} Comparison;
+
+#define RESULTS_SAME    0
+#define RESULTS_FASTER  1
+#define RESULTS_SLOWER  2
+
+void resultsInit(Results *results);
+void resultsFree(Results *results);
+void resultsAdd(ScenarioResults *s, uint32_t seed, const SimResult *result);
+int resultsWrite(const Results *results, const char *file);
+int resultsRead(Results *results, const char *file);
+void resultsCompare(const ScenarioResults *base, const ScenarioResults *now, Comparison *out);
+
+#endif
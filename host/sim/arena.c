@@ -0,0 +1,468 @@
+/*******************************************************************************
+ * Program Name         : arena.c
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Runs a crowd of robots with the same module in one
+ *                        shared world. They bump into and shade each other
+ *                        through a spatial hash of where each one stood at
+ *                        the end of the last tick.
+ *
+ *                        Each tick has two halves. First every robot's module
+ *                        runs to the end of the tick, spread over a pool of
+ *                        threads. Robots are dealt to the threads in a fixed
+ *                        order so a coroutine is always resumed on the same
+ *                        thread, and robots only read the hash while they
+ *                        run, so the threads need no locking. Then the main
+ *                        thread alone moves the world on, takes out robots
+ *                        that have finished and builds the hash again. As no
+ *                        robot sees another part way through a tick, a run
+ *                        comes out the same with any number of threads.
+ *
+ *                        Every robot needs its own copy of the module's static
+ *                        state, and dlopen of a file already loaded only hands
+ *                        back the same copy. dlmopen only allows a handful of
+ *                        namespaces, so each robot loads its own copy of the
+ *                        shared object from a temporary directory.
+ *******************************************************************************/
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+/* one robot and its own copy of the module */
+typedef struct
+{
+    SimRobot *robot;
+    void *module;
+    int running;            // module still going and scenario not done
+    int present;            // still standing in the world
+    int touching;           // against another robot at the last tick
+} Member;
+
+typedef struct
+{
+    Member *member;
+    int n, threads;
+    int stop;               // workers leave at the next tick
+    pthread_barrier_t tickStart, tickEnd;
+} Arena;
+
+typedef struct
+{
+    Arena *arena;
+    int first;              // runs robots first, first + threads, ...
+} Worker;
+
+static int loadCopies(Arena *arena, int scenario);
+static void *workerMain(void *arg);
+static void runSlice(Arena *arena, int first);
+static int finishTick(Arena *arena, SimWorld *world, SimCrowd *crowd, SimBody *bodies, SimArenaResult *result);
+static int cellOf(double v);
+static unsigned cellHash(int cx, int cy, int buckets);
+
+/*******************************************************************************
+ * Function Name        : simArenaRun
+ *    Returns           : 0 if the run happened, -1 if it could not be set up
+ *    Parameter         : arena configuration, result filled in
+ * Description          : One run of the crowd until every robot has finished
+ *                        or the time limit passes. Robot n has seed
+ *                        cfg->run.seed + n. A robot that finishes is lifted
+ *                        out so it does not block the rest.
+ *******************************************************************************/
+int simArenaRun(const SimArenaConfig *cfg, SimArenaResult *result)
+{
+    Arena arena;
+    Worker *workers;
+    pthread_t *threads;
+    SimWorld world;
+    SimCrowd crowd;
+    SimBody *bodies;
+    struct timespec start, end;
+    int64_t limit;
+    int i, running;
+
+    memset(result, 0, sizeof(*result));
+    memset(&arena, 0, sizeof(arena));
+    arena.n = cfg->robots;
+    arena.threads = cfg->threads > 0 ? cfg->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(arena.threads < 1)
+        arena.threads = 1;
+    if(arena.threads > arena.n)
+        arena.threads = arena.n;
+
+    simWorldInit(&world, &cfg->run);
+    if(arena.n < 1 || arena.n > simWorldCapacity(&world)){
+        fprintf(stderr, "sim: %s holds 1 to %d robots\n", simScenarioName(cfg->run.scenario), simWorldCapacity(&world));
+        return -1;
+    }
+
+    arena.member = calloc(arena.n, sizeof(Member));
+    if(loadCopies(&arena, cfg->run.scenario) < 0){
+        for(i = 0; i < arena.n; i++)
+            if(arena.member[i].module)
+                dlclose(arena.member[i].module);
+        free(arena.member);
+        return -1;
+    }
+
+    result->robots = arena.n;
+    result->threads = arena.threads;
+    result->robot = calloc(arena.n, sizeof(SimArenaRobot));
+
+    for(i = 0; i < arena.n; i++){
+        SimRobot *r = malloc(sizeof(*r));
+
+        simRobotInit(r, &world, cfg->run.seed + i);
+        r->id = i;
+        r->batteryMv = cfg->run.batteryMv;
+        r->faults = cfg->run.faults;
+        simWorldPlaceNth(&world, r, i, arena.n);
+        r->entry = (int (*)(void))dlsym(arena.member[i].module, "robot_main");
+        simRobotStart(r);
+        arena.member[i].robot = r;
+        arena.member[i].running = 1;
+        arena.member[i].present = 1;
+        result->robot[i].seed = r->seed;
+    }
+
+    // everyone sees everyone else's start before the first tick
+    bodies = malloc(arena.n * sizeof(SimBody));
+    simCrowdInit(&crowd, arena.n);
+    world.crowd = &crowd;
+    finishTick(&arena, &world, &crowd, bodies, result);
+
+    pthread_barrier_init(&arena.tickStart, NULL, arena.threads);
+    pthread_barrier_init(&arena.tickEnd, NULL, arena.threads);
+    workers = malloc(arena.threads * sizeof(Worker));
+    threads = malloc(arena.threads * sizeof(pthread_t));
+    for(i = 0; i < arena.threads; i++){
+        workers[i].arena = &arena;
+        workers[i].first = i;
+        if(i > 0)
+            pthread_create(&threads[i], NULL, workerMain, &workers[i]);
+    }
+
+    limit = (int64_t)(cfg->run.limitS * 1e9);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // the main thread is worker 0, it also does the second half of each tick
+    running = arena.n;
+    while(running > 0 && arena.member[0].robot->tickEnd <= limit){
+        pthread_barrier_wait(&arena.tickStart);
+        runSlice(&arena, 0);
+        pthread_barrier_wait(&arena.tickEnd);
+        running = finishTick(&arena, &world, &crowd, bodies, result);
+        result->simS = arena.member[0].robot->tickEnd * 1e-9;
+        for(i = 0; i < arena.n; i++)
+            arena.member[i].robot->tickEnd += SIM_TICK_NS;
+    }
+
+    arena.stop = 1;
+    pthread_barrier_wait(&arena.tickStart);
+    for(i = 1; i < arena.threads; i++)
+        pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    result->wallS = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+    for(i = 0; i < arena.n; i++){
+        SimRobot *r = arena.member[i].robot;
+
+        if(!result->robot[i].success)
+            result->robot[i].timeS = cfg->run.limitS;
+        result->robot[i].distanceM = r->odometer;
+        simModuleStats(arena.member[i].module, r, &result->robot[i].control);
+        free(r->stack);
+        free(r);
+        dlclose(arena.member[i].module);
+    }
+
+    pthread_barrier_destroy(&arena.tickStart);
+    pthread_barrier_destroy(&arena.tickEnd);
+    simCrowdFree(&crowd);
+    free(bodies);
+    free(workers);
+    free(threads);
+    free(arena.member);
+    return 0;
+}
+
+void simArenaFree(SimArenaResult *result)
+{
+    free(result->robot);
+    result->robot = NULL;
+}
+
+/*******************************************************************************
+ * Function Name        : loadCopies
+ *    Returns           : 0, or -1 if a copy would not load
+ *    Parameter         : arena, scenario whose module to load
+ * Description          : Copies the module once per robot and loads each
+ *                        copy. The files are removed as soon as they are
+ *                        loaded, the mappings stay until dlclose.
+ *******************************************************************************/
+static int loadCopies(Arena *arena, int scenario)
+{
+    char path[PATH_MAX], dir[PATH_MAX], copy[PATH_MAX + 32];
+    const char *tmp = getenv("TMPDIR");
+    FILE *in, *out;
+    char *image;
+    long size;
+    int i, status = 0;
+
+    simModulePath(scenario, path, sizeof(path));
+    in = fopen(path, "rb");
+    if(!in){
+        perror(path);
+        return -1;
+    }
+    fseek(in, 0, SEEK_END);
+    size = ftell(in);
+    rewind(in);
+    image = malloc(size);
+    if(fread(image, 1, size, in) != (size_t)size){
+        fprintf(stderr, "sim: could not read %s\n", path);
+        fclose(in);
+        free(image);
+        return -1;
+    }
+    fclose(in);
+
+    snprintf(dir, sizeof(dir), "%s/marco-arena-XXXXXX", tmp ? tmp : "/tmp");
+    if(!mkdtemp(dir)){
+        perror(dir);
+        free(image);
+        return -1;
+    }
+
+    for(i = 0; i < arena->n && status == 0; i++){
+        snprintf(copy, sizeof(copy), "%s/robot%d.so", dir, i);
+        out = fopen(copy, "wb");
+        if(!out || fwrite(image, 1, size, out) != (size_t)size){
+            perror(copy);
+            status = -1;
+        }
+        if(out)
+            fclose(out);
+        if(status == 0){
+            arena->member[i].module = dlopen(copy, RTLD_NOW | RTLD_LOCAL);
+            if(!arena->member[i].module){
+                fprintf(stderr, "sim: %s\n", dlerror());
+                status = -1;
+            }
+        }
+        unlink(copy);
+    }
+
+    rmdir(dir);
+    free(image);
+    return status;
+}
+
+static void *workerMain(void *arg)
+{
+    Worker *w = arg;
+
+    for(;;){
+        pthread_barrier_wait(&w->arena->tickStart);
+        if(w->arena->stop)
+            break;
+        runSlice(w->arena, w->first);
+        pthread_barrier_wait(&w->arena->tickEnd);
+    }
+    return NULL;
+}
+
+// first half of a tick, this thread's share of the robots run to the end of it
+static void runSlice(Arena *arena, int first)
+{
+    SimRobot *r;
+    int i;
+
+    for(i = first; i < arena->n; i += arena->threads){
+        if(!arena->member[i].running)
+            continue;
+        r = arena->member[i].robot;
+        simCurrent = r;
+        swapcontext(&r->sched, &r->ctx);
+        simCurrent = NULL;
+        simRobotSync(r);
+    }
+}
+
+/*******************************************************************************
+ * Function Name        : finishTick
+ *    Returns           : robots still running
+ *    Parameter         : arena, world, hash and space for the bodies in it,
+ *                        result to note finishes and contacts in
+ * Description          : Second half of a tick, on the main thread only.
+ *                        A robot whose module has stopped stays where it is
+ *                        as an obstacle, one that has finished the scenario
+ *                        is taken out. Contacts count each time a robot
+ *                        comes up against another, not how long they touch.
+ *******************************************************************************/
+static int finishTick(Arena *arena, SimWorld *world, SimCrowd *crowd, SimBody *bodies, SimArenaResult *result)
+{
+    const SimBody *near[crowd->max];
+    Member *m;
+    SimRobot *r;
+    double dx, dy, reach;
+    int i, k, n = 0, running = 0, touching;
+
+    for(i = 0; i < arena->n; i++){
+        m = &arena->member[i];
+        r = m->robot;
+        if(!m->running)
+            continue;
+        simWorldTick(world, r);
+        if(simWorldDone(world, r)){
+            result->robot[i].success = 1;
+            result->robot[i].timeS = r->now * 1e-9;
+            result->finished++;
+            m->running = 0;
+            m->present = 0;
+        }
+        else if(r->finished)
+            m->running = 0;
+        else
+            running++;
+    }
+
+    for(i = 0; i < arena->n; i++)
+        if(arena->member[i].present){
+            r = arena->member[i].robot;
+            bodies[n++] = (SimBody){ r->x, r->y, r->id };
+        }
+    simCrowdBuild(crowd, bodies, n);
+
+    for(i = 0; i < arena->n; i++){
+        m = &arena->member[i];
+        if(!m->present)
+            continue;
+        r = m->robot;
+        // a contact ends a bumper's reach further off than it starts, so two
+        // robots pushing against each other do not count it over and over
+        reach = m->touching ? SIM_CROWD_CELL + SIM_BUMPER_REACH : SIM_CROWD_CELL;
+        touching = 0;
+        n = simCrowdNear(crowd, r->x, r->y, near, crowd->max);
+        for(k = 0; k < n && !touching; k++){
+            dx = near[k]->x - r->x;
+            dy = near[k]->y - r->y;
+            touching = near[k]->id != r->id && dx * dx + dy * dy <= reach * reach;
+        }
+        if(touching && !m->touching){
+            result->robot[i].contacts++;
+            result->contacts++;
+        }
+        m->touching = touching;
+    }
+
+    return running;
+}
+
+/*******************************************************************************
+ * Spatial hash
+ *******************************************************************************/
+
+void simCrowdInit(SimCrowd *crowd, int max)
+{
+    memset(crowd, 0, sizeof(*crowd));
+    crowd->max = max;
+    // a power of two at least twice the bodies keeps the buckets short
+    for(crowd->buckets = 16; crowd->buckets < 2 * max; crowd->buckets *= 2)
+        ;
+    crowd->body = malloc(max * sizeof(SimBody));
+    crowd->bucketOf = malloc(max * sizeof(int));
+    crowd->start = malloc((crowd->buckets + 1) * sizeof(int));
+}
+
+void simCrowdFree(SimCrowd *crowd)
+{
+    free(crowd->body);
+    free(crowd->bucketOf);
+    free(crowd->start);
+    memset(crowd, 0, sizeof(*crowd));
+}
+
+/*******************************************************************************
+ * Function Name        : simCrowdBuild
+ *    Returns           : void
+ *    Parameter         : hash, bodies to put in it, how many
+ * Description          : Counting sort of the bodies by bucket, so each
+ *                        bucket is one run of the body array
+ *******************************************************************************/
+void simCrowdBuild(SimCrowd *crowd, const SimBody *bodies, int n)
+{
+    int i, b;
+
+    crowd->n = n;
+    memset(crowd->start, 0, (crowd->buckets + 1) * sizeof(int));
+    for(i = 0; i < n; i++){
+        crowd->bucketOf[i] = (int)cellHash(cellOf(bodies[i].x), cellOf(bodies[i].y), crowd->buckets);
+        crowd->start[crowd->bucketOf[i] + 1]++;
+    }
+    for(b = 0; b < crowd->buckets; b++)
+        crowd->start[b + 1] += crowd->start[b];
+
+    // start[b] is bucket b's fill point, which leaves it at the start of the
+    // next bucket, so everything moves up one afterwards
+    for(i = 0; i < n; i++)
+        crowd->body[crowd->start[crowd->bucketOf[i]]++] = bodies[i];
+    for(b = crowd->buckets; b > 0; b--)
+        crowd->start[b] = crowd->start[b - 1];
+    crowd->start[0] = 0;
+}
+
+/*******************************************************************************
+ * Function Name        : simCrowdNear
+ *    Returns           : number of bodies in the cells, more than max if
+ *                        some did not fit
+ *    Parameter         : hash, point, space for max bodies
+ * Description          : Every body in the 3x3 cells round the point, which
+ *                        includes every one within SIM_CROWD_CELL of it. Cells
+ *                        that share a bucket would give its bodies twice so
+ *                        a bucket is only read once, and bodies from far off
+ *                        that share a bucket are left out. Space for
+ *                        crowd->max bodies always holds them all.
+ *******************************************************************************/
+int simCrowdNear(const SimCrowd *crowd, double x, double y, const SimBody **near, int max)
+{
+    unsigned seen[9], b;
+    int cx = cellOf(x), cy = cellOf(y), dx, dy, k, i, used = 0, n = 0;
+
+    for(dy = -1; dy <= 1; dy++){
+        for(dx = -1; dx <= 1; dx++){
+            b = cellHash(cx + dx, cy + dy, crowd->buckets);
+            for(k = 0; k < used && seen[k] != b; k++)
+                ;
+            if(k < used)
+                continue;
+            seen[used++] = b;
+            for(i = crowd->start[b]; i < crowd->start[b + 1]; i++){
+                if(abs(cellOf(crowd->body[i].x) - cx) > 1 || abs(cellOf(crowd->body[i].y) - cy) > 1)
+                    continue;
+                if(n < max)
+                    near[n] = &crowd->body[i];
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+static int cellOf(double v)
+{
+    return (int)floor(v / SIM_CROWD_CELL);
+}
+
+static unsigned cellHash(int cx, int cy, int buckets)
+{
+    return ((unsigned)cx * 73856093u ^ (unsigned)cy * 19349663u) & (unsigned)(buckets - 1);
+}
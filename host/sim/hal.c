@@ -0,0 +1,403 @@
+/*******************************************************************************
+ * Program Name         : hal.c
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : The Altera HAL calls and libc calls the modules make,
+ *                        implemented against the simulated robot that is
+ *                        currently running (simCurrent). Also owns the robot's
+ *                        clock: every access advances it, peripherals are
+ *                        polled as it passes their next event, and the robot
+ *                        coroutine hands back to the world at each tick.
+ *******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "system.h"
+#include "sys/alt_irq.h"
+#include "sys/alt_timestamp.h"
+
+#define ROBOT_STACK_SIZE (256 * 1024)
+
+// PIO and JTAG UART register offsets
+#define PIO_DATA        0
+#define PIO_DIRECTION   1
+#define PIO_IRQ_MASK    2
+#define PIO_EDGE_CAP    3
+#define UART_DATA       0
+#define UART_CONTROL    1
+#define UART_WE         0x2
+#define TIMER_STATUS    0
+#define TIMER_CONTROL   1
+#define TIMER_PERIODL   2
+#define TIMER_PERIODH   3
+#define TIMER_TO        0x1
+#define TIMER_RUN       0x2
+#define TIMER_ITO       0x1
+#define TIMER_CONT      0x2
+#define TIMER_START     0x4
+#define TIMER_STOP      0x8
+
+// ADC interface bits, as used by read_adc()
+#define ADC_START_FLAG  0x8000
+#define ADC_DONE_FLAG   0x8000
+
+/* robot whose module is running on this thread */
+__thread SimRobot *simCurrent;
+
+static void robotEntry(void);
+static void serviceEvents(SimRobot *r);
+static void updateNextEvent(SimRobot *r);
+static void callIsr(SimRobot *r, int irq);
+static void spend(SimRobot *r, int64_t ns);
+static int64_t timerPeriodNs(const SimRobot *r);
+
+/*******************************************************************************
+ * Function Name        : simRobotStart
+ *    Returns           : void
+ *    Parameter         : robot with entry already set
+ * Description          : Creates the coroutine the module runs on. It does not
+ *                        run until the world first swaps to it.
+ *******************************************************************************/
+void simRobotStart(SimRobot *robot)
+{
+    robot->stack = malloc(ROBOT_STACK_SIZE);
+    getcontext(&robot->ctx);
+    robot->ctx.uc_stack.ss_sp = robot->stack;
+    robot->ctx.uc_stack.ss_size = ROBOT_STACK_SIZE;
+    robot->ctx.uc_link = &robot->sched;
+    makecontext(&robot->ctx, robotEntry, 0);
+    robot->finished = 0;
+    updateNextEvent(robot);
+}
+
+static void robotEntry(void)
+{
+    SimRobot *r = simCurrent;
+
+    r->entry();
+    // a module returning from main has stopped for good
+    r->finished = 1;
+}
+
+/*******************************************************************************
+ * Function Name        : simAdvance
+ *    Returns           : void
+ *    Parameter         : robot, ns of time to pass
+ * Description          : Moves the robot's clock on, stopping at every
+ *                        peripheral event on the way so interrupts land at the
+ *                        right time, and yielding to the world at tick ends.
+ *******************************************************************************/
+void simAdvance(SimRobot *r, int64_t ns)
+{
+    int64_t target = r->now + ns;
+
+    while(r->now < target){
+        r->now = (r->nextEvent < target) ? r->nextEvent : target;
+        if(r->now >= r->nextEvent)
+            serviceEvents(r);
+    }
+}
+
+// one bus access, kept cheap as some modules spin on the header
+static void spend(SimRobot *r, int64_t ns)
+{
+    r->now += ns;
+    if(r->now >= r->nextEvent)
+        serviceEvents(r);
+}
+
+static void updateNextEvent(SimRobot *r)
+{
+    int64_t next = r->tickEnd;
+    int canIrq = !r->inIsr && !r->irqDisabled;
+
+    if(r->irqMask && r->nextEdgePoll < next)
+        next = r->nextEdgePoll;
+    if((r->uartControl & UART_WE) && r->uartFifo > 0 && r->uartDrained + SIM_UART_BYTE_NS < next)
+        next = r->uartDrained + SIM_UART_BYTE_NS;
+    if((r->timerStatus & TIMER_RUN) && r->timerNext < next)
+        next = r->timerNext;
+
+    // an interrupt that is already pending goes at the next access
+    if(canIrq && (r->edgeCap & r->irqMask) && r->isr[EXPANSION_JP1_IRQ])
+        next = r->now;
+    if(canIrq && (r->uartControl & UART_WE) && r->uartFifo <= SIM_UART_FIFO - 8 && r->isr[JTAG_UART_IRQ])
+        next = r->now;
+    if(canIrq && (r->timerStatus & TIMER_TO) && (r->timerControl & TIMER_ITO) && r->isr[CONTROL_TIMER_IRQ])
+        next = r->now;
+    r->nextEvent = next;
+}
+
+static void serviceEvents(SimRobot *r)
+{
+    uint32_t inputs, edges;
+    int64_t bytes;
+
+    // JTAG UART empties its FIFO at the link rate
+    if(r->uartFifo > 0){
+        bytes = (r->now - r->uartDrained) / SIM_UART_BYTE_NS;
+        if(bytes >= r->uartFifo){
+            r->uartFifo = 0;
+            r->uartDrained = r->now;
+        }
+        else{
+            r->uartFifo -= (int)bytes;
+            r->uartDrained += bytes * SIM_UART_BYTE_NS;
+        }
+    }
+    else
+        r->uartDrained = r->now;
+
+    // PIO edge capture, sampled
+    if(r->irqMask && r->now >= r->nextEdgePoll){
+        inputs = simRobotInputs(r);
+        edges = (inputs ^ r->lastInputs) & r->irqMask;
+        r->lastInputs = inputs;
+        r->edgeCap |= edges;
+        r->nextEdgePoll = r->now + SIM_EDGE_POLL_NS;
+    }
+
+    // interval timer, reloads itself when continuous
+    if((r->timerStatus & TIMER_RUN) && r->now >= r->timerNext){
+        r->timerStatus |= TIMER_TO;
+        if(r->timerControl & TIMER_CONT)
+            r->timerNext += timerPeriodNs(r);
+        else
+            r->timerStatus &= ~TIMER_RUN;
+    }
+
+    if((r->timerStatus & TIMER_TO) && (r->timerControl & TIMER_ITO))
+        callIsr(r, CONTROL_TIMER_IRQ);
+    if(r->edgeCap & r->irqMask)
+        callIsr(r, EXPANSION_JP1_IRQ);
+    if((r->uartControl & UART_WE) && r->uartFifo <= SIM_UART_FIFO - 8)
+        callIsr(r, JTAG_UART_IRQ);
+
+    if(r->now >= r->tickEnd && !r->finished){
+        swapcontext(&r->ctx, &r->sched);
+    }
+
+    updateNextEvent(r);
+}
+
+static void callIsr(SimRobot *r, int irq)
+{
+    if(r->inIsr || r->irqDisabled || !r->isr[irq])
+        return;
+    r->inIsr = 1;
+    r->isr[irq](r->isrContext[irq]);
+    r->inIsr = 0;
+}
+
+/*******************************************************************************
+ * Register access
+ *******************************************************************************/
+
+alt_u32 simIoRead(alt_u32 base, alt_u32 reg)
+{
+    SimRobot *r = simCurrent;
+    alt_u32 value = 0;
+
+    spend(r, SIM_IO_NS);
+
+    switch(base){
+        case EXPANSION_JP1_BASE :
+            if(reg == PIO_DATA)
+                value = simRobotInputs(r);
+            else if(reg == PIO_IRQ_MASK)
+                value = r->irqMask;
+            else if(reg == PIO_EDGE_CAP)
+                value = r->edgeCap;
+            break;
+
+        case ADC_SPI_READ_BASE :
+            if((r->adcReg & ADC_START_FLAG) && r->now >= r->adcDone)
+                value = ADC_DONE_FLAG | r->adcValue;
+            break;
+
+        case JTAG_UART_BASE :
+            if(reg == UART_CONTROL)
+                value = r->uartControl | ((alt_u32)(SIM_UART_FIFO - r->uartFifo) << 16);
+            break;
+
+        case CONTROL_TIMER_BASE :
+            if(reg == TIMER_STATUS)
+                value = r->timerStatus;
+            else if(reg == TIMER_CONTROL)
+                value = r->timerControl;
+            else if(reg == TIMER_PERIODL)
+                value = r->timerPeriod & 0xFFFF;
+            else if(reg == TIMER_PERIODH)
+                value = r->timerPeriod >> 16;
+            break;
+    }
+    return value;
+}
+
+void simIoWrite(alt_u32 base, alt_u32 reg, alt_u32 data)
+{
+    SimRobot *r = simCurrent;
+
+    spend(r, SIM_IO_NS);
+
+    switch(base){
+        case EXPANSION_JP1_BASE :
+            if(reg == PIO_DATA){
+                if(data != r->out)
+                    simRobotWriteHeader(r, data);
+            }
+            else if(reg == PIO_IRQ_MASK){
+                r->irqMask = data;
+                r->lastInputs = simRobotInputs(r);
+                r->nextEdgePoll = r->now + SIM_EDGE_POLL_NS;
+                updateNextEvent(r);
+            }
+            else if(reg == PIO_EDGE_CAP)
+                r->edgeCap &= ~data;
+            break;
+
+        case ADC_SPI_READ_BASE :
+            // value is sampled as the conversion starts
+            if((data & ADC_START_FLAG) && !(r->adcReg & ADC_START_FLAG)){
+                r->adcValue = simRobotAdc(r, data & 0x7);
+                r->adcDone = r->now + SIM_ADC_CONVERT_NS;
+                // a timed out conversion never says it is done
+                if(simRobotFault(r, r->faults.adcTimeout))
+                    r->adcDone = INT64_MAX;
+            }
+            r->adcReg = data;
+            break;
+
+        case JTAG_UART_BASE :
+            if(reg == UART_DATA){
+                if(r->uartFifo < SIM_UART_FIFO){
+                    if(r->uartFifo == 0)
+                        r->uartDrained = r->now;
+                    r->uartFifo++;
+                    if(r->uartSink)
+                        fputc((int)(data & 0xFF), r->uartSink);
+                }
+            }
+            else if(reg == UART_CONTROL){
+                r->uartControl = data & 0x3;
+                updateNextEvent(r);
+            }
+            break;
+
+        case CONTROL_TIMER_BASE :
+            // any write to status clears the timeout
+            if(reg == TIMER_STATUS)
+                r->timerStatus &= ~TIMER_TO;
+            else if(reg == TIMER_CONTROL){
+                r->timerControl = data & (TIMER_ITO | TIMER_CONT);
+                if(data & TIMER_STOP)
+                    r->timerStatus &= ~TIMER_RUN;
+                else if(data & TIMER_START){
+                    r->timerStatus |= TIMER_RUN;
+                    r->timerNext = r->now + timerPeriodNs(r);
+                }
+            }
+            // the real core also stops when its period is written
+            else if(reg == TIMER_PERIODL){
+                r->timerPeriod = (r->timerPeriod & 0xFFFF0000) | (data & 0xFFFF);
+                r->timerStatus &= ~TIMER_RUN;
+            }
+            else if(reg == TIMER_PERIODH){
+                r->timerPeriod = (r->timerPeriod & 0xFFFF) | ((data & 0xFFFF) << 16);
+                r->timerStatus &= ~TIMER_RUN;
+            }
+            updateNextEvent(r);
+            break;
+    }
+}
+
+static int64_t timerPeriodNs(const SimRobot *r)
+{
+    return ((int64_t)r->timerPeriod + 1) * 1000000000 / CONTROL_TIMER_FREQ;
+}
+
+/*******************************************************************************
+ * HAL services
+ *******************************************************************************/
+
+int alt_ic_isr_register(alt_u32 ic_id, alt_u32 irq, alt_isr_func isr, void *isr_context, void *flags)
+{
+    SimRobot *r = simCurrent;
+
+    (void)ic_id;
+    (void)flags;
+    if(irq >= 32)
+        return -1;
+    r->isr[irq] = isr;
+    r->isrContext[irq] = isr_context;
+    return 0;
+}
+
+alt_irq_context alt_irq_disable_all(void)
+{
+    SimRobot *r = simCurrent;
+    alt_irq_context was = r->irqDisabled;
+
+    r->irqDisabled = 1;
+    return was;
+}
+
+void alt_irq_enable_all(alt_irq_context context)
+{
+    simCurrent->irqDisabled = (int)context;
+    updateNextEvent(simCurrent);
+}
+
+int alt_timestamp_start(void)
+{
+    return 0;
+}
+
+alt_timestamp_type alt_timestamp(void)
+{
+    return (alt_timestamp_type)(simCurrent->now / (1000000000 / ALT_CPU_FREQ));
+}
+
+alt_u32 alt_timestamp_freq(void)
+{
+    return ALT_CPU_FREQ;
+}
+
+/*******************************************************************************
+ * libc replacements, see sim_target.h
+ *******************************************************************************/
+
+int simUsleep(unsigned int us)
+{
+    simAdvance(simCurrent, (int64_t)us * 1000);
+    return 0;
+}
+
+// xorshift so every robot has its own repeatable sequence
+int simRand(void)
+{
+    SimRobot *r = simCurrent;
+
+    r->rng ^= r->rng << 13;
+    r->rng ^= r->rng >> 17;
+    r->rng ^= r->rng << 5;
+    return (int)(r->rng & 0x7FFFFFFF);
+}
+
+void simSrand(unsigned int seed)
+{
+    simCurrent->rng = seed ? seed : 1;
+}
+
+time_t simTime(time_t *t)
+{
+    // the seed stands in for the wall clock so runs repeat
+    time_t now = (time_t)simCurrent->seed * 7919 + (time_t)(simCurrent->now / 1000000000);
+
+    if(t)
+        *t = now;
+    return now;
+}
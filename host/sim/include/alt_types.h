@@ -0,0 +1,23 @@
+/*******************************************************************************
+ * Program Name         : alt_types.h
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Altera HAL integer types for host builds.
+ *******************************************************************************/
+
+#ifndef SIM_ALT_TYPES_H
+#define SIM_ALT_TYPES_H
+
+#include <stdint.h>
+
+typedef int8_t   alt_8;
+typedef uint8_t  alt_u8;
+typedef int16_t  alt_16;
+typedef uint16_t alt_u16;
+typedef int32_t  alt_32;
+typedef uint32_t alt_u32;
+typedef int64_t  alt_64;
+typedef uint64_t alt_u64;
+
+#endif
@@ -0,0 +1,24 @@
+/*******************************************************************************
+ * Program Name         : altera_avalon_jtag_uart_regs.h
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : JTAG UART register map, same layout as the real core.
+ *******************************************************************************/
+
+#ifndef SIM_ALTERA_AVALON_JTAG_UART_REGS_H
+#define SIM_ALTERA_AVALON_JTAG_UART_REGS_H
+
+#include "io.h"
+
+#define IORD_ALTERA_AVALON_JTAG_UART_DATA(base)             IORD(base, 0)
+#define IOWR_ALTERA_AVALON_JTAG_UART_DATA(base, data)       IOWR(base, 0, data)
+#define IORD_ALTERA_AVALON_JTAG_UART_CONTROL(base)          IORD(base, 1)
+#define IOWR_ALTERA_AVALON_JTAG_UART_CONTROL(base, data)    IOWR(base, 1, data)
+
+#define ALTERA_AVALON_JTAG_UART_CONTROL_RE_MSK              (0x00000001)
+#define ALTERA_AVALON_JTAG_UART_CONTROL_WE_MSK              (0x00000002)
+#define ALTERA_AVALON_JTAG_UART_CONTROL_WSPACE_MSK          (0xFFFF0000)
+#define ALTERA_AVALON_JTAG_UART_CONTROL_WSPACE_OFST         (16)
+
+#endif
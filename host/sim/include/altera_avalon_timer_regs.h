@@ -0,0 +1,32 @@
+/*******************************************************************************
+ * Program Name         : altera_avalon_timer_regs.h
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Interval timer register map, same offsets and bits
+ *                        as the real core.
+ *******************************************************************************/
+
+#ifndef SIM_ALTERA_AVALON_TIMER_REGS_H
+#define SIM_ALTERA_AVALON_TIMER_REGS_H
+
+#include "io.h"
+
+#define IORD_ALTERA_AVALON_TIMER_STATUS(base)           IORD(base, 0)
+#define IOWR_ALTERA_AVALON_TIMER_STATUS(base, data)     IOWR(base, 0, data)
+#define IORD_ALTERA_AVALON_TIMER_CONTROL(base)          IORD(base, 1)
+#define IOWR_ALTERA_AVALON_TIMER_CONTROL(base, data)    IOWR(base, 1, data)
+#define IORD_ALTERA_AVALON_TIMER_PERIODL(base)          IORD(base, 2)
+#define IOWR_ALTERA_AVALON_TIMER_PERIODL(base, data)    IOWR(base, 2, data)
+#define IORD_ALTERA_AVALON_TIMER_PERIODH(base)          IORD(base, 3)
+#define IOWR_ALTERA_AVALON_TIMER_PERIODH(base, data)    IOWR(base, 3, data)
+
+#define ALTERA_AVALON_TIMER_STATUS_TO_MSK               0x1
+#define ALTERA_AVALON_TIMER_STATUS_RUN_MSK              0x2
+
+#define ALTERA_AVALON_TIMER_CONTROL_ITO_MSK             0x1
+#define ALTERA_AVALON_TIMER_CONTROL_CONT_MSK            0x2
+#define ALTERA_AVALON_TIMER_CONTROL_START_MSK           0x4
+#define ALTERA_AVALON_TIMER_CONTROL_STOP_MSK            0x8
+
+#endif
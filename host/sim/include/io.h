@@ -0,0 +1,21 @@
+/*******************************************************************************
+ * Program Name         : io.h
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Register access for host builds. Every IORD/IOWR
+ *                        goes to the simulated robot and costs bus time.
+ *******************************************************************************/
+
+#ifndef SIM_IO_H
+#define SIM_IO_H
+
+#include "alt_types.h"
+
+alt_u32 simIoRead(alt_u32 base, alt_u32 reg);
+void simIoWrite(alt_u32 base, alt_u32 reg, alt_u32 data);
+
+#define IORD(base, reg)         simIoRead((base), (reg))
+#define IOWR(base, reg, data)   simIoWrite((base), (reg), (data))
+
+#endif
@@ -0,0 +1,36 @@
+/*******************************************************************************
+ * Program Name         : sim_target.h
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Forced in front of every robot module built for the
+ *                        simulator (gcc -include). Points the libc calls the
+ *                        modules make that touch time or randomness at the
+ *                        simulated robot, renames main so the simulator can
+ *                        start it, and routes the tuning constants through
+ *                        simTunable[].
+ *******************************************************************************/
+
+#ifndef SIM_TARGET_H
+#define SIM_TARGET_H
+
+/* real declarations first so the renames below only hit the calls */
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+
+int simUsleep(unsigned int us);
+int simRand(void);
+void simSrand(unsigned int seed);
+time_t simTime(time_t *t);
+
+#define usleep  simUsleep
+#define rand    simRand
+#define srand   simSrand
+#define time    simTime
+
+#define main    robot_main
+
+#include "tunables.h"
+
+#endif
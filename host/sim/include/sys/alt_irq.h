@@ -0,0 +1,23 @@
+/*******************************************************************************
+ * Program Name         : sys/alt_irq.h
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Interrupt API for host builds. ISRs are called by
+ *                        the simulator between register accesses.
+ *******************************************************************************/
+
+#ifndef SIM_ALT_IRQ_H
+#define SIM_ALT_IRQ_H
+
+#include "alt_types.h"
+
+typedef void (*alt_isr_func)(void *isr_context);
+typedef alt_u32 alt_irq_context;
+
+int alt_ic_isr_register(alt_u32 ic_id, alt_u32 irq, alt_isr_func isr, void *isr_context, void *flags);
+
+alt_irq_context alt_irq_disable_all(void);
+void alt_irq_enable_all(alt_irq_context context);
+
+#endif
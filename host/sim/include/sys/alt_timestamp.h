@@ -0,0 +1,21 @@
+/*******************************************************************************
+ * Program Name         : sys/alt_timestamp.h
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Timestamp timer for host builds, counts simulated
+ *                        time at ALT_CPU_FREQ.
+ *******************************************************************************/
+
+#ifndef SIM_ALT_TIMESTAMP_H
+#define SIM_ALT_TIMESTAMP_H
+
+#include "alt_types.h"
+
+typedef alt_u32 alt_timestamp_type;
+
+int alt_timestamp_start(void);
+alt_timestamp_type alt_timestamp(void);
+alt_u32 alt_timestamp_freq(void);
+
+#endif
@@ -0,0 +1,34 @@
+/*******************************************************************************
+ * Program Name         : system.h
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Stand in for the BSP generated system.h when the
+ *                        robot modules are built for the simulator. Base
+ *                        addresses only need to be distinct, sim/hal.c
+ *                        decides what each one does.
+ *******************************************************************************/
+
+#ifndef SIM_SYSTEM_H
+#define SIM_SYSTEM_H
+
+#define EXPANSION_JP1_BASE                          0x1000
+#define EXPANSION_JP1_IRQ                           3
+#define EXPANSION_JP1_IRQ_INTERRUPT_CONTROLLER_ID   0
+
+#define LED_BASE                                    0x2000
+
+#define ADC_SPI_READ_BASE                           0x3000
+
+#define JTAG_UART_BASE                              0x4000
+#define JTAG_UART_IRQ                               1
+#define JTAG_UART_IRQ_INTERRUPT_CONTROLLER_ID       0
+
+#define CONTROL_TIMER_BASE                          0x5000
+#define CONTROL_TIMER_IRQ                           2
+#define CONTROL_TIMER_IRQ_INTERRUPT_CONTROLLER_ID   0
+#define CONTROL_TIMER_FREQ                          50000000
+
+#define ALT_CPU_FREQ                                50000000
+
+#endif
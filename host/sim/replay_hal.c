@@ -0,0 +1,93 @@
+/*******************************************************************************
+ * Program Name         : replay_hal.c
+ * Project              : Marco Robot Coursework - host tools
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : The HAL and libc calls a module built for replay
+ *                        makes. Every input the module acts on comes out of
+ *                        the recording (see Recorder.h) so nothing here needs
+ *                        a robot: registers read as idle, interrupts are never
+ *                        raised and time does not pass.
+ *******************************************************************************/
+
+#include <time.h>
+
+#include "system.h"
+#include "alt_types.h"
+#include "sys/alt_irq.h"
+#include "sys/alt_timestamp.h"
+
+#define PIO_DATA        0
+
+alt_u32 simIoRead(alt_u32 base, alt_u32 reg)
+{
+    // inputs are active low, so nothing pressed
+    if(base == EXPANSION_JP1_BASE && reg == PIO_DATA)
+        return 0xFFFFFFFF;
+    return 0;
+}
+
+void simIoWrite(alt_u32 base, alt_u32 reg, alt_u32 data)
+{
+    (void)base;
+    (void)reg;
+    (void)data;
+}
+
+int alt_ic_isr_register(alt_u32 ic_id, alt_u32 irq, alt_isr_func isr, void *isr_context, void *flags)
+{
+    (void)ic_id;
+    (void)irq;
+    (void)isr;
+    (void)isr_context;
+    (void)flags;
+    return 0;
+}
+
+alt_irq_context alt_irq_disable_all(void)
+{
+    return 0;
+}
+
+void alt_irq_enable_all(alt_irq_context context)
+{
+    (void)context;
+}
+
+int alt_timestamp_start(void)
+{
+    return 0;
+}
+
+alt_timestamp_type alt_timestamp(void)
+{
+    return 0;
+}
+
+alt_u32 alt_timestamp_freq(void)
+{
+    return ALT_CPU_FREQ;
+}
+
+int simUsleep(unsigned int us)
+{
+    (void)us;
+    return 0;
+}
+
+int simRand(void)
+{
+    return 0;
+}
+
+void simSrand(unsigned int seed)
+{
+    (void)seed;
+}
+
+time_t simTime(time_t *t)
+{
+    if(t)
+        *t = 0;
+    return 0;
+}
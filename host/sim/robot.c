@@ -0,0 +1,473 @@
+/*******************************************************************************
+ * Program Name         : robot.c
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Physical model of one MARCO robot. Wheels follow the
+ *                        motor bits with a first order lag at a speed set by
+ *                        the battery, the body moves as a differential drive
+ *                        and is pushed back out of walls, and in an arena out
+ *                        of the other robots.
+ *                        Sensors are worked out from the pose whenever the
+ *                        module reads the header or starts an ADC conversion.
+ *******************************************************************************/
+
+#include <math.h>
+#include <string.h>
+
+#include "sim.h"
+
+#define PHYS_STEP_NS    250000      // longest physics step
+#define BUMPER_SECTOR   1.58        // rad either side of straight ahead
+#define BUMPER_OVERLAP  0.17        // rad either side of ahead where both trip
+#define ADC_AMBIENT     100
+#define HEADING_WANDER  0.05        // rad/sqrt(s) of random heading drift from wheel slip
+
+/* stepper nibble (bits 28-31) for each of the eight half steps */
+static const uint32_t stepNibble[8] = { 0x8, 0x9, 0x1, 0x5, 0x4, 0x6, 0x2, 0xA };
+
+static void step(SimRobot *r, double dt);
+static double wheelTarget(uint32_t out, uint32_t enable, uint32_t forward, double gain);
+static int stepIndex(uint32_t nibble);
+static void pushOutOfWalls(SimRobot *r);
+static void pushOutOfRobots(SimRobot *r);
+static uint32_t bumpers(const SimRobot *r);
+static uint32_t contact(const SimRobot *r, double dx, double dy);
+static double slip(SimRobot *r);
+static uint32_t flicker(SimRobot *r);
+static uint32_t bounce(SimRobot *r, uint32_t contacts);
+static double faultUniform(SimRobot *r);
+static void responded(SimRobot *r, uint32_t value);
+
+/*******************************************************************************
+ * Function Name        : simRobotInit
+ *    Returns           : void
+ *    Parameter         : robot, world it lives in, seed for its variations
+ * Description          : Resets the robot to power on state. Pose is set by
+ *                        the world afterwards.
+ *******************************************************************************/
+void simRobotInit(SimRobot *robot, SimWorld *world, uint32_t seed)
+{
+    memset(robot, 0, sizeof(*robot));
+    robot->world = world;
+    robot->seed = seed;
+    robot->rng = seed * 2654435761u + 1;
+    robot->slipRng = seed * 0x9E3779B9u + 0x6A09E667u;
+    robot->faultRng = seed * 0x85EBCA6Bu + 0xC2B2AE35u;
+    robot->out = 0;
+    robot->eyePos = SIM_EYE_STEPS / 2;
+    robot->eyePhase = -1;
+    robot->gainL = 1.0;
+    robot->gainR = 1.0;
+    robot->batteryMv = SIM_BATTERY_NOMINAL_MV;
+    robot->lastInputs = 0xFFFFFFFF;
+    robot->sensed = SIM_LEFT_FLOOR_SENSOR | SIM_RIGHT_FLOOR_SENSOR | SIM_LEFT_FRONT_BUMPER | SIM_RIGHT_FRONT_BUMPER;
+    robot->changedAt = -1;
+    robot->tickEnd = SIM_TICK_NS;
+}
+
+/*******************************************************************************
+ * Function Name        : simRobotSync
+ *    Returns           : void
+ *    Parameter         : robot
+ * Description          : Brings the pose up to the robot's clock using the
+ *                        motor bits in force since it was last synced.
+ *******************************************************************************/
+void simRobotSync(SimRobot *r)
+{
+    int64_t dt;
+
+    while(r->physT < r->now){
+        dt = r->now - r->physT;
+        if(dt > PHYS_STEP_NS)
+            dt = PHYS_STEP_NS;
+        step(r, dt * 1e-9);
+        r->physT += dt;
+    }
+}
+
+static void step(SimRobot *r, double dt)
+{
+    double k = 1.0 - exp(-dt / SIM_MOTOR_TAU);
+    double battery = r->batteryMv / SIM_BATTERY_NOMINAL_MV;
+    double v, w;
+
+    r->vl += (wheelTarget(r->out, SIM_LEFT_ENABLE, SIM_LEFT_FORWARD, r->gainL * battery) - r->vl) * k;
+    r->vr += (wheelTarget(r->out, SIM_RIGHT_ENABLE, SIM_RIGHT_FORWARD, r->gainR * battery) - r->vr) * k;
+    r->batteryMv -= SIM_BATTERY_DRAIN_MV * dt * (((r->out & SIM_LEFT_ENABLE) != 0) + ((r->out & SIM_RIGHT_ENABLE) != 0));
+
+    v = (r->vl + r->vr) / 2;
+    w = (r->vr - r->vl) / SIM_WHEEL_BASE;
+
+    r->x += v * cos(r->heading) * dt;
+    r->y += v * sin(r->heading) * dt;
+    r->heading += w * dt + HEADING_WANDER * sqrt(dt) * slip(r);
+    r->odometer += fabs(v) * dt;
+
+    if(r->world->crowd)
+        pushOutOfRobots(r);
+    if(r->world->nWalls)
+        pushOutOfWalls(r);
+}
+
+static double wheelTarget(uint32_t out, uint32_t enable, uint32_t forward, double gain)
+{
+    if(!(out & enable))
+        return 0.0;
+    return ((out & forward) ? SIM_WHEEL_SPEED : -SIM_WHEEL_SPEED) * gain;
+}
+
+/*******************************************************************************
+ * Function Name        : simRobotWriteHeader
+ *    Returns           : void
+ *    Parameter         : robot, new value of the header outputs
+ * Description          : Motor bits take effect from now. A change of stepper
+ *                        nibble to the neighbouring half step moves the eye
+ *                        one step, the end stops hold it at the switches.
+ *                        With the stepMiss fault a step can be lost.
+ *******************************************************************************/
+void simRobotWriteHeader(SimRobot *r, uint32_t value)
+{
+    int index, delta;
+
+    if((value ^ r->out) & 0xF){
+        simRobotSync(r);
+        responded(r, value);
+    }
+
+    index = stepIndex(value >> 28);
+    if(index >= 0){
+        if(r->eyePhase >= 0){
+            delta = (index - r->eyePhase + 8) % 8;
+            if((delta == 1 || delta == 7) && simRobotFault(r, r->faults.stepMiss))
+                delta = 0;  // rotor did not follow, the eye stays put
+            if(delta == 1 && r->eyePos < SIM_EYE_STEPS)
+                r->eyePos++;
+            else if(delta == 7 && r->eyePos > 0)
+                r->eyePos--;
+        }
+        r->eyePhase = index;
+    }
+
+    r->out = value;
+}
+
+static int stepIndex(uint32_t nibble)
+{
+    int i;
+
+    for(i = 0; i < 8; i++)
+        if(stepNibble[i] == nibble)
+            return i;
+    return -1;
+}
+
+/*******************************************************************************
+ * Function Name        : simRobotInputs
+ *    Returns           : header input bits, active low like the real robot
+ *    Parameter         : robot
+ * Description          : Floor sensors see the tape under them, bumpers trip
+ *                        on walls in their half of the front, eye switches
+ *                        trip at the stepper end stops. Floor flicker and
+ *                        bumper bounce faults are put on top.
+ *******************************************************************************/
+uint32_t simRobotInputs(SimRobot *r)
+{
+    uint32_t in = 0xFFFFFFFF, sensed;
+    double c, s, fx, fy;
+
+    simRobotSync(r);
+
+    if(r->world->track){
+        c = cos(r->heading);
+        s = sin(r->heading);
+        fx = r->x + c * SIM_SENSOR_AHEAD;
+        fy = r->y + s * SIM_SENSOR_AHEAD;
+        // left sensor is to the robot's left, +90 degrees
+        if(simWorldOnTape(r->world, fx - s * SIM_SENSOR_SPREAD, fy + c * SIM_SENSOR_SPREAD))
+            in &= ~SIM_LEFT_FLOOR_SENSOR;
+        if(simWorldOnTape(r->world, fx + s * SIM_SENSOR_SPREAD, fy - c * SIM_SENSOR_SPREAD))
+            in &= ~SIM_RIGHT_FLOOR_SENSOR;
+    }
+
+    // floor bits are active low so a flicker just inverts them
+    in ^= flicker(r);
+    in &= ~bounce(r, bumpers(r));
+
+    // start timing the response to a change of floor or bumper
+    sensed = in & (SIM_LEFT_FLOOR_SENSOR | SIM_RIGHT_FLOOR_SENSOR | SIM_LEFT_FRONT_BUMPER | SIM_RIGHT_FRONT_BUMPER);
+    if(sensed != r->sensed && r->changedAt < 0)
+        r->changedAt = r->now;
+    r->sensed = sensed;
+
+    if(r->eyePos >= SIM_EYE_STEPS)
+        in &= ~SIM_LEFT_EYE_SWITCH;
+    if(r->eyePos <= 0)
+        in &= ~SIM_RIGHT_EYE_SWITCH;
+
+    return in;
+}
+
+// nearest point of a wall to (x, y)
+static void nearest(const SimWall *w, double x, double y, double *nx, double *ny)
+{
+    double dx = w->x2 - w->x1, dy = w->y2 - w->y1;
+    double t = ((x - w->x1) * dx + (y - w->y1) * dy) / (dx * dx + dy * dy);
+
+    if(t < 0)
+        t = 0;
+    if(t > 1)
+        t = 1;
+    *nx = w->x1 + t * dx;
+    *ny = w->y1 + t * dy;
+}
+
+static void pushOutOfWalls(SimRobot *r)
+{
+    const SimWorld *world = r->world;
+    double nx, ny, dx, dy, d;
+    int i;
+
+    for(i = 0; i < world->nWalls; i++){
+        nearest(&world->walls[i], r->x, r->y, &nx, &ny);
+        dx = r->x - nx;
+        dy = r->y - ny;
+        d = sqrt(dx * dx + dy * dy);
+        if(d < SIM_ROBOT_RADIUS && d > 1e-9){
+            r->x = nx + dx / d * SIM_ROBOT_RADIUS;
+            r->y = ny + dy / d * SIM_ROBOT_RADIUS;
+        }
+    }
+}
+
+/*******************************************************************************
+ * Function Name        : pushOutOfRobots
+ *    Returns           : void
+ *    Parameter         : robot
+ * Description          : The others stand where they were at the end of the
+ *                        last tick and this robot is moved clear of them.
+ *                        Two robots driving into each other both back off,
+ *                        each by the overlap they had last tick, which is
+ *                        far less than a millimetre at wheel speed.
+ *******************************************************************************/
+static void pushOutOfRobots(SimRobot *r)
+{
+    const SimCrowd *crowd = r->world->crowd;
+    const SimBody *near[crowd->max];
+    double dx, dy, d;
+    int i, n;
+
+    n = simCrowdNear(crowd, r->x, r->y, near, crowd->max);
+    for(i = 0; i < n; i++){
+        if(near[i]->id == r->id)
+            continue;
+        dx = r->x - near[i]->x;
+        dy = r->y - near[i]->y;
+        d = sqrt(dx * dx + dy * dy);
+        if(d < 2 * SIM_ROBOT_RADIUS && d > 1e-9){
+            r->x = near[i]->x + dx / d * 2 * SIM_ROBOT_RADIUS;
+            r->y = near[i]->y + dy / d * 2 * SIM_ROBOT_RADIUS;
+        }
+    }
+}
+
+static uint32_t bumpers(const SimRobot *r)
+{
+    const SimWorld *world = r->world;
+    uint32_t pressed = 0;
+    double nx, ny, dx, dy;
+    int i, n;
+
+    for(i = 0; i < world->nWalls; i++){
+        nearest(&world->walls[i], r->x, r->y, &nx, &ny);
+        dx = nx - r->x;
+        dy = ny - r->y;
+        if(dx * dx + dy * dy <= (SIM_ROBOT_RADIUS + SIM_BUMPER_REACH) * (SIM_ROBOT_RADIUS + SIM_BUMPER_REACH))
+            pressed |= contact(r, dx, dy);
+    }
+
+    // another robot touches where the line between the centres crosses the body
+    if(world->crowd){
+        const SimBody *near[world->crowd->max];
+
+        n = simCrowdNear(world->crowd, r->x, r->y, near, world->crowd->max);
+        for(i = 0; i < n; i++){
+            dx = near[i]->x - r->x;
+            dy = near[i]->y - r->y;
+            if(near[i]->id != r->id && dx * dx + dy * dy <= SIM_CROWD_CELL * SIM_CROWD_CELL)
+                pressed |= contact(r, dx, dy);
+        }
+    }
+    return pressed;
+}
+
+// bumpers tripped by a contact in direction (dx, dy) from the centre
+static uint32_t contact(const SimRobot *r, double dx, double dy)
+{
+    uint32_t pressed = 0;
+    // angle of the contact from straight ahead, positive to the left
+    double a = remainder(atan2(dy, dx) - r->heading, 2 * M_PI);
+
+    if(a > -BUMPER_OVERLAP && a < BUMPER_SECTOR)
+        pressed |= SIM_LEFT_FRONT_BUMPER;
+    if(a < BUMPER_OVERLAP && a > -BUMPER_SECTOR)
+        pressed |= SIM_RIGHT_FRONT_BUMPER;
+    return pressed;
+}
+
+/*******************************************************************************
+ * Function Name        : simRobotAdc
+ *    Returns           : 12 bit conversion result
+ *    Parameter         : robot, ADC channel
+ * Description          : Channel 1 is the light sensor on the stepper, it
+ *                        looks along the body heading plus the eye angle.
+ *                        SIM_BATTERY_CHANNEL reads the pack voltage.
+ *******************************************************************************/
+uint16_t simRobotAdc(SimRobot *r, int channel)
+{
+    double eye, value;
+
+    if(channel == SIM_BATTERY_CHANNEL)
+        return (uint16_t)(r->batteryMv * 4095 / SIM_BATTERY_FULL_SCALE);
+    if(channel != 1)
+        return 0;
+
+    simRobotSync(r);
+
+    eye = ((double)r->eyePos / SIM_EYE_STEPS - 0.5) * SIM_EYE_RANGE;
+    value = ADC_AMBIENT + simWorldLight(r->world, r->x, r->y, r->heading + eye);
+    if(value > 4095)
+        value = 4095;
+    return (uint16_t)value;
+}
+
+/*******************************************************************************
+ * Function Name        : responded
+ *    Returns           : void
+ *    Parameter         : robot, header value being written
+ * Description          : Off ticks of the duty are not a response, only a
+ *                        wheel driving the other way to the last time it
+ *                        drove, or driving for the first time. A wheel
+ *                        switching off is not one either, steered at part
+ *                        duty the inner wheel does that every few ticks.
+ *                        The first response after a sensor change ends its
+ *                        latency.
+ *******************************************************************************/
+static void responded(SimRobot *r, uint32_t value)
+{
+    static const uint32_t enable[2] = {SIM_LEFT_ENABLE, SIM_RIGHT_ENABLE};
+    static const uint32_t forward[2] = {SIM_LEFT_FORWARD, SIM_RIGHT_FORWARD};
+    uint32_t drive = r->drive;
+    int64_t ns;
+    int i;
+
+    // drive keeps each wheel's enable and forward bits from when it last drove
+    for(i = 0; i < 2; i++)
+        if(value & enable[i])
+            drive = (drive & ~forward[i]) | enable[i] | (value & forward[i]);
+    if(drive == r->drive)
+        return;
+    r->drive = drive;
+
+    if(r->changedAt < 0)
+        return;
+    ns = r->now - r->changedAt;
+    r->changedAt = -1;
+    for(i = 0; i < SIM_LATENCY_BUCKETS; i++)
+        if(ns < (int64_t)SIM_LATENCY_FIRST_NS << i){
+            r->latency[i]++;
+            break;
+        }
+}
+
+/*******************************************************************************
+ * Function Name        : simRobotFault
+ *    Returns           : 1 if the fault happens this time
+ *    Parameter         : robot, chance of it happening
+ * Description          : Draws from the fault sequence only when the chance
+ *                        is above 0, so a robot without faults runs exactly
+ *                        as it did before they existed
+ *******************************************************************************/
+int simRobotFault(SimRobot *r, double chance)
+{
+    return chance > 0 && faultUniform(r) < chance;
+}
+
+/*******************************************************************************
+ * Function Name        : flicker
+ *    Returns           : floor sensor bits reading wrong at the moment
+ *    Parameter         : robot
+ * Description          : Each sensor starts a false reading at
+ *                        floorFlickerHz on average, lasting around
+ *                        SIM_FLICKER_NS, like a sensor over a tape edge or
+ *                        a scuff on the floor
+ *******************************************************************************/
+static uint32_t flicker(SimRobot *r)
+{
+    static const uint32_t bit[2] = { SIM_LEFT_FLOOR_SENSOR, SIM_RIGHT_FLOOR_SENSOR };
+    double chance;
+    uint32_t wrong = 0;
+    int i;
+
+    if(r->faults.floorFlickerHz <= 0)
+        return 0;
+
+    chance = 1.0 - exp(-r->faults.floorFlickerHz * (r->now - r->flickerChecked) * 1e-9);
+    r->flickerChecked = r->now;
+
+    for(i = 0; i < 2; i++){
+        if(r->now >= r->flickerUntil[i] && simRobotFault(r, chance))
+            r->flickerUntil[i] = r->now + (int64_t)(SIM_FLICKER_NS * (0.5 + faultUniform(r)));
+        if(r->now < r->flickerUntil[i])
+            wrong |= bit[i];
+    }
+    return wrong;
+}
+
+/*******************************************************************************
+ * Function Name        : bounce
+ *    Returns           : bumper bits as the header sees them, 1 = pressed
+ *    Parameter         : robot, bumper bits actually closed
+ * Description          : A bumper that has just opened or closed reads at
+ *                        random for bumperBounceMs
+ *******************************************************************************/
+static uint32_t bounce(SimRobot *r, uint32_t contacts)
+{
+    uint32_t changed = contacts ^ r->contacts, seen = contacts;
+
+    if(r->faults.bumperBounceMs <= 0)
+        return contacts;
+
+    r->contacts = contacts;
+    if(changed){
+        r->bouncing |= changed;
+        r->bounceUntil = r->now + (int64_t)(r->faults.bumperBounceMs * 1e6);
+    }
+    if(r->now >= r->bounceUntil)
+        r->bouncing = 0;
+
+    if((r->bouncing & SIM_LEFT_FRONT_BUMPER) && faultUniform(r) < 0.5)
+        seen ^= SIM_LEFT_FRONT_BUMPER;
+    if((r->bouncing & SIM_RIGHT_FRONT_BUMPER) && faultUniform(r) < 0.5)
+        seen ^= SIM_RIGHT_FRONT_BUMPER;
+    return seen;
+}
+
+static double faultUniform(SimRobot *r)
+{
+    r->faultRng = r->faultRng * 1664525u + 1013904223u;
+    return (r->faultRng >> 8) / 16777216.0;
+}
+
+// roughly normal with unit variance, from the robot's own slip sequence
+static double slip(SimRobot *r)
+{
+    double sum = 0;
+    int i;
+
+    for(i = 0; i < 3; i++){
+        r->slipRng = r->slipRng * 1664525u + 1013904223u;
+        sum += (r->slipRng >> 8) / 16777216.0;
+    }
+    return (sum - 1.5) * 2.0;
+}
@@ -0,0 +1,258 @@
+/*******************************************************************************
+ * Program Name         : sim.c
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Runs one module in one scenario. The module for the
+ *                        scenario is loaded fresh from its shared object each
+ *                        run so none of its static state carries over, then
+ *                        the world and the module take turns a tick at a time
+ *                        until the scenario is done or the time limit passes.
+ *******************************************************************************/
+
+#include <dlfcn.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "Recorder.h"
+
+static const char *scenarioNames[SIM_SCENARIOS] = { "line", "light", "escape", "obstacle" };
+
+/* shared object holding each scenario's module, next to the executable */
+static const char *moduleFiles[SIM_SCENARIOS] = { "line.so", "light.so", "escape.so", "line.so" };
+
+/* SimFaults members by the name they are set with */
+static const struct
+{
+    const char *name;
+    size_t offset;
+} faultNames[] = {
+    { "flicker", offsetof(SimFaults, floorFlickerHz) },
+    { "bounce",  offsetof(SimFaults, bumperBounceMs) },
+    { "adc",     offsetof(SimFaults, adcTimeout) },
+    { "step",    offsetof(SimFaults, stepMiss) },
+    { "asym",    offsetof(SimFaults, motorAsymmetry) },
+};
+
+#define FAULTS ((int)(sizeof(faultNames) / sizeof(faultNames[0])))
+
+const char *simScenarioName(int scenario)
+{
+    return (scenario >= 0 && scenario < SIM_SCENARIOS) ? scenarioNames[scenario] : "?";
+}
+
+int simScenarioFind(const char *name)
+{
+    int i;
+
+    for(i = 0; i < SIM_SCENARIOS; i++)
+        if(!strcmp(scenarioNames[i], name))
+            return i;
+    return -1;
+}
+
+void simConfigDefaults(SimConfig *cfg, int scenario)
+{
+    static const double limits[SIM_SCENARIOS] = { 120, 120, 300, 120 };
+
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->scenario = scenario;
+    cfg->seed = 1;
+    cfg->limitS = limits[scenario];
+    cfg->laps = 1;
+    cfg->batteryMv = SIM_BATTERY_NOMINAL_MV;
+}
+
+/*******************************************************************************
+ * Function Name        : simFaultSet
+ *    Returns           : 0, or -1 if there is no fault of that name
+ *    Parameter         : faults to change, fault name, new level
+ * Description          : Names are flicker, bounce, adc, step and asym, in
+ *                        the order and units of SimFaults
+ *******************************************************************************/
+int simFaultSet(SimFaults *faults, const char *name, double value)
+{
+    int i;
+
+    for(i = 0; i < FAULTS; i++)
+        if(!strcmp(faultNames[i].name, name)){
+            *(double *)((char *)faults + faultNames[i].offset) = value;
+            return 0;
+        }
+    return -1;
+}
+
+// name of the nth fault, NULL past the last
+const char *simFaultName(int fault)
+{
+    return (fault >= 0 && fault < FAULTS) ? faultNames[fault].name : NULL;
+}
+
+// level of the nth fault, in the units of SimFaults
+double simFaultLevel(const SimFaults *faults, int fault)
+{
+    return *(const double *)((const char *)faults + faultNames[fault].offset);
+}
+
+// path of a file sitting beside the running executable
+static void besideExe(const char *file, char *path, size_t size)
+{
+    char exe[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+
+    if(n <= 0){
+        snprintf(path, size, "./%s", file);
+        return;
+    }
+    exe[n] = '\0';
+    snprintf(path, size, "%s/%s", dirname(exe), file);
+}
+
+// shared object of the scenario's module
+void simModulePath(int scenario, char *path, size_t size)
+{
+    besideExe(moduleFiles[scenario], path, size);
+}
+
+/*******************************************************************************
+ * Function Name        : simModuleStats
+ *    Returns           : void
+ *    Parameter         : loaded module, its robot, copy to fill in
+ * Description          : Asks the module's Control for its counts, as the
+ *                        module itself would at the end of a run. Left zeroed
+ *                        if it was built without Control.
+ *******************************************************************************/
+void simModuleStats(void *module, SimRobot *robot, ControlStats *copy)
+{
+    void (*stats)(ControlStats *) = (void (*)(ControlStats *))dlsym(module, "controlStats");
+
+    memset(copy, 0, sizeof(*copy));
+    if(!stats)
+        return;
+    // it turns interrupts off round the copy, which goes through the robot
+    simCurrent = robot;
+    stats(copy);
+    simCurrent = NULL;
+}
+
+/*******************************************************************************
+ * Function Name        : saveRecording
+ *    Returns           : void
+ *    Parameter         : loaded module, file to write
+ * Description          : Writes out the module's Recorder buffer the same way
+ *                        it is dumped from a real robot, header then the used
+ *                        part of the data, ready for replay
+ *******************************************************************************/
+static void saveRecording(void *module, const char *file)
+{
+    const Recording *rec = dlsym(module, "recording");
+    FILE *out;
+
+    if(!rec){
+        fprintf(stderr, "sim: module has no recording\n");
+        return;
+    }
+    out = fopen(file, "wb");
+    if(!out){
+        perror(file);
+        return;
+    }
+    fwrite(rec, 1, offsetof(Recording, data) + rec->used, out);
+    fclose(out);
+    if(rec->full)
+        fprintf(stderr, "sim: recording filled up, only the start was kept\n");
+}
+
+/*******************************************************************************
+ * Function Name        : simRun
+ *    Returns           : 0 if the run happened, -1 if the module would not load
+ *    Parameter         : run configuration, result filled in
+ * Description          : One complete run of a scenario
+ *******************************************************************************/
+int simRun(const SimConfig *cfg, SimResult *result)
+{
+    char path[PATH_MAX];
+    void *module;
+    SimWorld world;
+    SimRobot *robot;
+    int64_t limit;
+
+    simModulePath(cfg->scenario, path, sizeof(path));
+    module = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if(!module){
+        fprintf(stderr, "sim: %s\n", dlerror());
+        return -1;
+    }
+
+    robot = malloc(sizeof(*robot));
+    simWorldInit(&world, cfg);
+    simRobotInit(robot, &world, cfg->seed);
+    robot->batteryMv = cfg->batteryMv;
+    robot->faults = cfg->faults;
+    simWorldPlace(&world, robot);
+    robot->entry = (int (*)(void))dlsym(module, "robot_main");
+    if(cfg->telemetry)
+        robot->uartSink = fopen(cfg->telemetry, "wb");
+    simRobotStart(robot);
+
+    limit = (int64_t)(cfg->limitS * 1e9);
+    result->success = 0;
+
+    while(!robot->finished && robot->tickEnd <= limit){
+        simCurrent = robot;
+        swapcontext(&robot->sched, &robot->ctx);
+        simCurrent = NULL;
+
+        simRobotSync(robot);
+        simWorldTick(&world, robot);
+        if(simWorldDone(&world, robot)){
+            result->success = 1;
+            break;
+        }
+        robot->tickEnd += SIM_TICK_NS;
+    }
+
+    result->timeS = result->success ? robot->now * 1e-9 : cfg->limitS;
+    result->distanceM = robot->odometer;
+    simModuleStats(module, robot, &result->control);
+    memcpy(result->latency, robot->latency, sizeof(result->latency));
+
+    if(cfg->recording)
+        saveRecording(module, cfg->recording);
+    if(robot->uartSink)
+        fclose(robot->uartSink);
+    free(robot->stack);
+    free(robot);
+    dlclose(module);
+    return 0;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+// ascending, ready for simPercentile
+void simSort(double *values, int n)
+{
+    qsort(values, n, sizeof(double), compareDouble);
+}
+
+// nearest rank percentile of sorted values
+double simPercentile(const double *sorted, int n, double p)
+{
+    int rank = (int)(p / 100.0 * n + 0.999999);
+
+    if(rank < 1)
+        rank = 1;
+    if(rank > n)
+        rank = n;
+    return sorted[rank - 1];
+}
@@ -0,0 +1,328 @@
+/*******************************************************************************
+ * Program Name         : sim.h
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Simulated MARCO robot for benchmarking the modules on
+ *                        the PC. The unmodified module source is built as a
+ *                        shared object against the headers in sim/include and
+ *                        run as a coroutine. Every register access, usleep and
+ *                        ISR advances the robot's own clock and the world moves
+ *                        the robot from the motor bits it last wrote.
+ *
+ *                        Scenarios:
+ *                          line   - lap of a closed tape course with curves
+ *                                   and square corners (LineFollower)
+ *                          light  - reach a lamp across a walled room
+ *                                   (LightFollower)
+ *                          escape - leave a walled room through a door
+ *                                   (EscapeTheRoom)
+ *                          obstacle - the line course with a box left on
+ *                                   the first straight (LineFollower)
+ *
+ *                        An arena (arena.c) runs a crowd of robots in one of
+ *                        these worlds at once.
+ *******************************************************************************/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <ucontext.h>
+
+#include "tunables.h"
+#include "Control.h"
+
+/* Scenarios */
+#define SIM_LINE        0
+#define SIM_LIGHT       1
+#define SIM_ESCAPE      2
+#define SIM_OBSTACLE    3
+#define SIM_SCENARIOS   4
+
+/* Header bits, all active low (same as the modules) */
+#define SIM_LEFT_FLOOR_SENSOR   0x4000
+#define SIM_RIGHT_FLOOR_SENSOR  0x2000
+#define SIM_LEFT_FRONT_BUMPER   0x8000
+#define SIM_RIGHT_FRONT_BUMPER  0x800
+#define SIM_LEFT_EYE_SWITCH     0x20000
+#define SIM_RIGHT_EYE_SWITCH    0x10000
+
+/* Motor nibble, per wheel an enable bit and a forward bit */
+#define SIM_LEFT_ENABLE         0x1
+#define SIM_RIGHT_ENABLE        0x2
+#define SIM_LEFT_FORWARD        0x4
+#define SIM_RIGHT_FORWARD       0x8
+
+/* Robot */
+#define SIM_WHEEL_SPEED         0.25        // m/s with a wheel fully on
+#define SIM_WHEEL_BASE          0.10        // m between wheels
+#define SIM_MOTOR_TAU           0.005       // s, motor/wheel time constant
+#define SIM_ROBOT_RADIUS        0.09        // m, body is treated as a circle
+#define SIM_SENSOR_AHEAD        0.07        // m, floor sensors ahead of centre
+#define SIM_SENSOR_SPREAD       0.0075      // m, each floor sensor off centre
+#define SIM_EYE_STEPS           200         // half steps between eye switches
+#define SIM_EYE_RANGE           3.14159265358979  // rad swept by the eye
+
+/* Battery, wheel speed goes with pack voltage */
+#define SIM_BATTERY_NOMINAL_MV  7200        // SIM_WHEEL_SPEED is at this voltage
+#define SIM_BATTERY_DRAIN_MV    0.5         // mV lost per second of one wheel on
+#define SIM_BATTERY_CHANNEL     2           // ADC channel, as CONTROL_BATTERY_CHANNEL
+#define SIM_BATTERY_FULL_SCALE  10000       // mV at 4095, as CONTROL_BATTERY_FULL_SCALE_MV
+
+/* Bus and peripherals */
+#define SIM_IO_NS               200         // one register access
+#define SIM_TICK_NS             500000      // world step, robots sync at this rate
+#define SIM_ADC_CONVERT_NS      10000
+#define SIM_EDGE_POLL_NS        50000       // PIO edge capture sample period
+#define SIM_UART_FIFO           64
+#define SIM_UART_BYTE_NS        50000       // JTAG UART drain rate, 20kB/s
+
+/* Faults */
+#define SIM_FLICKER_NS          1000000     // mean length of a false floor reading
+
+/* Response latency, sensor bit change to the next change of drive. Bucket
+ * n counts latencies under SIM_LATENCY_FIRST_NS << n, longer are dropped
+ * as the change most likely needed no response */
+#define SIM_LATENCY_BUCKETS     9
+#define SIM_LATENCY_FIRST_NS    250000
+
+/* Arena, several robots sharing one world. Bodies are hashed into cells
+ * wide enough that anything touching a robot is in the 3x3 cells round it */
+#define SIM_BUMPER_REACH        0.006       // m past the body a bumper still trips
+#define SIM_CROWD_CELL          (2 * SIM_ROBOT_RADIUS + SIM_BUMPER_REACH)
+#define SIM_CROWD_SPACING       0.2         // m, closest robots are started
+
+#define SIM_MAX_WALLS           32
+
+typedef void (*SimIsr)(void *context);
+
+typedef struct
+{
+    double x1, y1, x2, y2;
+} SimWall;
+
+typedef struct SimWorld SimWorld;
+
+/* Where one arena robot was at the last tick, as the others see it */
+typedef struct
+{
+    double x, y;
+    int id;
+} SimBody;
+
+/* Spatial hash of the bodies, bucket b holds body[start[b]] up to
+ * body[start[b + 1]]. Rebuilt between ticks and only read during them */
+typedef struct
+{
+    SimBody *body;
+    int *start;
+    int *bucketOf;          // scratch for the build
+    int n, max, buckets;
+} SimCrowd;
+
+/* Hardware faults, all 0 for a clean robot. Set by name with simFaultSet() */
+typedef struct
+{
+    double floorFlickerHz;  // false readings a second from each floor sensor
+    double bumperBounceMs;  // a bumper chatters this long after it opens or closes
+    double adcTimeout;      // chance a conversion never finishes
+    double stepMiss;        // chance a stepper step leaves the eye where it was
+    double motorAsymmetry;  // right motor this much stronger than the left, 0.1 = 10%
+} SimFaults;
+
+typedef struct SimRobot
+{
+    /* clocks, all in ns of simulated time */
+    int64_t now;            // robot's own clock
+    int64_t tickEnd;        // yield to the world when now reaches this
+    int64_t nextEvent;      // earliest of tickEnd and the next peripheral poll
+    int64_t physT;          // pose is valid up to this time
+
+    /* coroutine running the module */
+    ucontext_t ctx;
+    ucontext_t sched;
+    void *stack;
+    int (*entry)(void);
+    int finished;
+
+    /* pose and wheels */
+    double x, y, heading;   // m, m, rad
+    int id;                 // SimBody id in an arena
+    double vl, vr;          // wheel ground speeds m/s
+    double gainL, gainR;    // per motor strength, models mismatched motors
+    double odometer;        // m travelled by the centre
+    double batteryMv;       // pack voltage, runs down as the wheels are driven
+
+    /* expansion header */
+    uint32_t out;           // last value written to the header
+    uint32_t irqMask;
+    uint32_t edgeCap;
+    uint32_t lastInputs;
+    int64_t nextEdgePoll;
+
+    /* light sensor stepper */
+    int eyePos;             // 0 at the right switch, SIM_EYE_STEPS at the left
+    int eyePhase;           // last step index written, -1 if none yet
+
+    /* ADC */
+    uint32_t adcReg;
+    int64_t adcDone;
+    uint16_t adcValue;
+
+    /* interval timer */
+    uint32_t timerControl;
+    uint32_t timerStatus;
+    uint32_t timerPeriod;   // period register, counts of ALT_CPU_FREQ less one
+    int64_t timerNext;      // time of the next timeout while running
+
+    /* JTAG UART */
+    uint32_t uartControl;
+    int uartFifo;
+    int64_t uartDrained;
+    FILE *uartSink;
+
+    /* interrupts */
+    SimIsr isr[32];
+    void *isrContext[32];
+    int irqDisabled;
+    int inIsr;
+
+    /* injected faults */
+    SimFaults faults;
+    int64_t flickerUntil[2];    // left and right floor sensor read wrong until then
+    int64_t flickerChecked;
+    uint32_t contacts;      // bumper bits actually closed at the last read
+    uint32_t bouncing;      // bumper bits chattering until bounceUntil
+    int64_t bounceUntil;
+
+    /* response latency */
+    uint32_t sensed;        // floor and bumper bits at the last read
+    uint32_t drive;         // each wheel's motor bits when it last drove
+    int64_t changedAt;      // first sensor change not yet answered, -1 if none
+    uint32_t latency[SIM_LATENCY_BUCKETS];
+
+    uint32_t rng;           // module's rand()
+    uint32_t slipRng;       // wheel slip, kept apart so rand() calls do not move it
+    uint32_t faultRng;      // faults, apart again so a clean run is unchanged
+    uint32_t seed;
+    SimWorld *world;
+
+    /* line: course progress */
+    int trackIndex;         // nearest course point last tick
+    double progress;        // m of the course covered, wraps to laps
+} SimRobot;
+
+struct SimWorld
+{
+    int scenario;
+    SimWall walls[SIM_MAX_WALLS];
+    int nWalls;
+
+    /* line: tape course */
+    const struct SimTrack *track;
+    int laps;
+
+    /* light */
+    double lightX, lightY;
+
+    /* escape: the robot is out once past this y */
+    double exitY;
+
+    /* other robots in an arena, NULL for a robot on its own */
+    const SimCrowd *crowd;
+};
+
+typedef struct
+{
+    int scenario;
+    uint32_t seed;
+    double limitS;          // give up after this much simulated time
+    int laps;               // line scenario only
+    const char *telemetry;  // file to write JTAG UART bytes to, or NULL
+    const char *recording;  // file to write the module's Recorder buffer to, or NULL
+    double batteryMv;       // pack voltage at the start
+    SimFaults faults;
+} SimConfig;
+
+typedef struct
+{
+    int success;
+    double timeS;           // time to finish, or limitS if it did not
+    double distanceM;
+    ControlStats control;   // module's own motor accounting at the end
+    uint32_t latency[SIM_LATENCY_BUCKETS];
+} SimResult;
+
+/* one robot of an arena run */
+typedef struct
+{
+    uint32_t seed;
+    int success;
+    double timeS;           // time to finish, or the limit if it did not
+    double distanceM;
+    int contacts;           // times it came up against another robot
+    ControlStats control;
+} SimArenaRobot;
+
+typedef struct
+{
+    SimConfig run;          // scenario, first seed, limit and so on for every robot
+    int robots;
+    int threads;            // 0 for one a processor
+} SimArenaConfig;
+
+typedef struct
+{
+    int robots, threads, finished, contacts;
+    SimArenaRobot *robot;   // one per robot, free with simArenaFree()
+    double simS;            // simulated time until the last robot finished or the limit
+    double wallS;           // real time it took
+} SimArenaResult;
+
+/* sim.c */
+const char *simScenarioName(int scenario);
+int simScenarioFind(const char *name);
+void simConfigDefaults(SimConfig *cfg, int scenario);
+int simRun(const SimConfig *cfg, SimResult *result);
+int simFaultSet(SimFaults *faults, const char *name, double value);
+const char *simFaultName(int fault);
+double simFaultLevel(const SimFaults *faults, int fault);
+void simModulePath(int scenario, char *path, size_t size);
+void simModuleStats(void *module, SimRobot *robot, ControlStats *copy);
+void simSort(double *values, int n);
+double simPercentile(const double *sorted, int n, double p);
+
+/* arena.c */
+int simArenaRun(const SimArenaConfig *cfg, SimArenaResult *result);
+void simArenaFree(SimArenaResult *result);
+void simCrowdInit(SimCrowd *crowd, int max);
+void simCrowdFree(SimCrowd *crowd);
+void simCrowdBuild(SimCrowd *crowd, const SimBody *bodies, int n);
+int simCrowdNear(const SimCrowd *crowd, double x, double y, const SimBody **near, int max);
+
+/* hal.c */
+extern __thread SimRobot *simCurrent;
+void simRobotStart(SimRobot *robot);
+void simAdvance(SimRobot *robot, int64_t ns);
+
+/* robot.c */
+void simRobotInit(SimRobot *robot, SimWorld *world, uint32_t seed);
+void simRobotSync(SimRobot *robot);
+uint32_t simRobotInputs(SimRobot *robot);
+void simRobotWriteHeader(SimRobot *robot, uint32_t value);
+uint16_t simRobotAdc(SimRobot *robot, int channel);
+int simRobotFault(SimRobot *robot, double chance);
+
+/* world.c */
+void simWorldInit(SimWorld *world, const SimConfig *cfg);
+void simWorldPlace(SimWorld *world, SimRobot *robot);
+int simWorldPlaceNth(SimWorld *world, SimRobot *robot, int nth, int of);
+void simWorldTick(SimWorld *world, SimRobot *robot);
+int simWorldDone(const SimWorld *world, const SimRobot *robot);
+int simWorldCapacity(const SimWorld *world);
+int simWorldOnTape(const SimWorld *world, double x, double y);
+double simWorldLight(const SimWorld *world, double x, double y, double bearing);
+
+#endif
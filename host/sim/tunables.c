@@ -0,0 +1,50 @@
+/*******************************************************************************
+ * Program Name         : tunables.c
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : The table behind tunables.h, kept on its own so every
+ *                        host tool that loads a module can link it.
+ *******************************************************************************/
+
+#include <string.h>
+
+#include "tunables.h"
+
+/* starts out at the module defaults */
+long simTunable[TUN_COUNT] =
+{
+#define TUNABLE(name, scenario, def, min, max, laps, step) def,
+#include "tunables.def"
+#undef TUNABLE
+};
+
+const SimTunableInfo simTunableInfo[TUN_COUNT] =
+{
+#define TUNABLE(name, scenario, def, min, max, laps, step) { #name, scenario, def, min, max, laps, step },
+#include "tunables.def"
+#undef TUNABLE
+};
+
+/*******************************************************************************
+ * Function Name        : simTunablesReset
+ *    Returns           : void
+ * Description          : Puts every tunable back to the module default
+ *******************************************************************************/
+void simTunablesReset(void)
+{
+    int i;
+
+    for(i = 0; i < TUN_COUNT; i++)
+        simTunable[i] = simTunableInfo[i].def;
+}
+
+int simTunableFind(const char *name)
+{
+    int i;
+
+    for(i = 0; i < TUN_COUNT; i++)
+        if(!strcmp(simTunableInfo[i].name, name))
+            return i;
+    return -1;
+}
@@ -0,0 +1,74 @@
+/*******************************************************************************
+ * Program Name         : tunables.h
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Runtime values behind the module tuning constants.
+ *                        When a module is built for the simulator each
+ *                        constant reads simTunable[] so one build can be run
+ *                        with any settings.
+ *******************************************************************************/
+
+#ifndef SIM_TUNABLES_H
+#define SIM_TUNABLES_H
+
+enum
+{
+#define TUNABLE(name, scenario, def, min, max, laps, step) TUN_##name,
+#include "tunables.def"
+#undef TUNABLE
+    TUN_COUNT
+};
+
+typedef struct
+{
+    const char *name;
+    const char *scenario;
+    long def, min, max;
+    int laps;                   // laps a run needs before it makes a difference
+    long step;                  // 0 any value in the range, else min + a multiple
+} SimTunableInfo;
+
+extern long simTunable[TUN_COUNT];
+extern const SimTunableInfo simTunableInfo[TUN_COUNT];
+
+void simTunablesReset(void);
+int simTunableFind(const char *name);
+
+/* one line per entry in tunables.def */
+#define LINE_DRIVE_US           ((int)simTunable[TUN_LINE_DRIVE_US])
+#define LINE_TURN_STOP_US       ((int)simTunable[TUN_LINE_TURN_STOP_US])
+#define LINE_FORWARD_STOP_US    ((int)simTunable[TUN_LINE_FORWARD_STOP_US])
+#define LINE_LOST_REPEATS       ((unsigned)simTunable[TUN_LINE_LOST_REPEATS])
+#define LINE_SHARP_US           ((int)simTunable[TUN_LINE_SHARP_US])
+#define LINE_CORNER_STOP_US     ((int)simTunable[TUN_LINE_CORNER_STOP_US])
+#define LINE_ARC_CURVE          ((int)simTunable[TUN_LINE_ARC_CURVE])
+#define LINE_BYPASS_SIDE        ((int)simTunable[TUN_LINE_BYPASS_SIDE])
+#define LINE_BYPASS_WAIT_US     ((unsigned)simTunable[TUN_LINE_BYPASS_WAIT_US])
+#define LINE_BYPASS_REVERSE_US  ((unsigned)simTunable[TUN_LINE_BYPASS_REVERSE_US])
+#define LINE_BYPASS_TURN_US     ((unsigned)simTunable[TUN_LINE_BYPASS_TURN_US])
+#define LINE_BYPASS_OUT_US      ((unsigned)simTunable[TUN_LINE_BYPASS_OUT_US])
+#define LINE_BYPASS_PAST_US     ((unsigned)simTunable[TUN_LINE_BYPASS_PAST_US])
+#define LINE_BYPASS_SEEK_US     ((unsigned)simTunable[TUN_LINE_BYPASS_SEEK_US])
+#define LINE_MAP                ((int)simTunable[TUN_LINE_MAP])
+#define LINE_MAP_CORNER_US      ((int)simTunable[TUN_LINE_MAP_CORNER_US])
+#define LINE_MAP_CURVE_US       ((int)simTunable[TUN_LINE_MAP_CURVE_US])
+#define LINE_MAP_BRAKE_STEPS    ((unsigned)simTunable[TUN_LINE_MAP_BRAKE_STEPS])
+#define LINE_MAP_BRAKE_US       ((unsigned)simTunable[TUN_LINE_MAP_BRAKE_US])
+#define LINE_MAP_MATCH_STEPS    ((unsigned)simTunable[TUN_LINE_MAP_MATCH_STEPS])
+#define LIGHT_ADC_SETTLE_US     ((int)simTunable[TUN_LIGHT_ADC_SETTLE_US])
+#define LIGHT_DRIVE_US          ((int)simTunable[TUN_LIGHT_DRIVE_US])
+#define LIGHT_THRESHOLD         ((int)simTunable[TUN_LIGHT_THRESHOLD])
+#define LIGHT_TURN_HARD_US      ((int)simTunable[TUN_LIGHT_TURN_HARD_US])
+#define LIGHT_TURN_WIDE_US      ((int)simTunable[TUN_LIGHT_TURN_WIDE_US])
+#define LIGHT_TURN_MEDIUM_US    ((int)simTunable[TUN_LIGHT_TURN_MEDIUM_US])
+#define LIGHT_TURN_SOFT_US      ((int)simTunable[TUN_LIGHT_TURN_SOFT_US])
+#define LIGHT_BEARING_ALPHA     ((int)simTunable[TUN_LIGHT_BEARING_ALPHA])
+#define LIGHT_BEARING_BETA      ((int)simTunable[TUN_LIGHT_BEARING_BETA])
+#define LIGHT_BEARING_FORGET_US ((unsigned)simTunable[TUN_LIGHT_BEARING_FORGET_US])
+#define LIGHT_PIVOT_ABOVE_US    ((int)simTunable[TUN_LIGHT_PIVOT_ABOVE_US])
+#define LIGHT_ARC_CURVE         ((int)simTunable[TUN_LIGHT_ARC_CURVE])
+#define ESCAPE_FORWARD_DUTY     ((int)simTunable[TUN_ESCAPE_FORWARD_DUTY])
+#define ESCAPE_ROTATE_US        ((int)simTunable[TUN_ESCAPE_ROTATE_US])
+
+#endif
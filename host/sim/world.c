@@ -0,0 +1,537 @@
+/*******************************************************************************
+ * Program Name         : world.c
+ * Project              : Marco Robot Coursework - host simulator
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : The benchmark worlds, where the robot starts in each
+ *                        and when it has finished. An arena starts a crowd of
+ *                        robots spread along the course or over a grid in the
+ *                        room, and they shade each other from the lamp.
+ *
+ *                        The tape course is built from straights, arcs and
+ *                        square corners, then drawn into a 1mm bitmap once so
+ *                        floor sensor reads are a single lookup.
+ *******************************************************************************/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+#define TAPE_HALF_WIDTH 0.0095      // m, 19mm tape
+#define RASTER_MM       1.0         // bitmap cell size
+#define PROGRESS_STEP   0.005       // m between course points used for progress
+#define PROGRESS_WINDOW 40          // course points searched either side per tick
+
+#define LIGHT_PEAK      2400.0      // ADC counts from the lamp at close range
+#define LIGHT_FALLOFF   2.0         // m at which the lamp reads half its peak
+#define LIGHT_CONE_POW  12          // sharpness of the light sensor's view
+#define LIGHT_REACHED   0.35        // m from the lamp counted as arrived
+
+#define OBSTACLE_AT     0.7         // m along the first straight
+#define OBSTACLE_HALF   0.05        // m, 100mm square box centred on the tape
+
+#define CROWD_SPREAD    0.4         // m, widest a small crowd is spread in a room
+
+/* Course pieces, lengths in mm and angles in degrees, left positive */
+typedef struct
+{
+    char type;          // 'S' straight, 'A' arc, 'C' square corner
+    double length;      // straight length or arc radius
+    double angle;
+} TrackPiece;
+
+static const TrackPiece course[] =
+{
+    { 'S', 1200, 0 },
+    { 'A', 250, 90 },
+    { 'S', 700, 0 },
+    { 'C', 0, 90 },
+    { 'S', 600, 0 },
+    { 'C', 0, -90 },
+    { 'S', 200, 0 },
+    { 'C', 0, 90 },
+    { 'S', 500, 0 },
+    { 'C', 0, 90 },
+    { 'S', 200, 0 },
+    { 'C', 0, -90 },
+    { 'S', 600, 0 },
+    { 'A', 150, 90 },
+    { 'S', 400, 0 },
+    { 'A', 400, 90 },
+};
+
+struct SimTrack
+{
+    double *px, *py;        // evenly spaced course points
+    int n;
+    double length;          // m round the course
+    unsigned char *bitmap;  // 1 where there is tape
+    int width, height;
+    double originX, originY;
+};
+
+/* square a crowd is started in, per scenario. Line robots go on the course */
+static const struct
+{
+    double x, y, span;
+} crowdArea[SIM_SCENARIOS] = {
+    { 0, 0, 0 },
+    { 1.3, 1.3, 2.0 },
+    { 1.0, 1.0, 1.5 },
+    { 0, 0, 0 },
+};
+
+static struct SimTrack track;
+static int trackBuilt;
+
+static void buildTrack(void);
+static void drawTapeSegment(double x1, double y1, double x2, double y2);
+static double uniform(uint32_t seed, int which);
+static int shaded(const SimCrowd *crowd, double x, double y, double toX, double toY);
+
+/*******************************************************************************
+ * Function Name        : simWorldInit
+ *    Returns           : void
+ *    Parameter         : world, run configuration
+ * Description          : Lays out walls, tape or lamp for the scenario
+ *******************************************************************************/
+void simWorldInit(SimWorld *world, const SimConfig *cfg)
+{
+    memset(world, 0, sizeof(*world));
+    world->scenario = cfg->scenario;
+    world->laps = cfg->laps > 0 ? cfg->laps : 1;
+
+    switch(cfg->scenario){
+        case SIM_LINE :
+        case SIM_OBSTACLE :
+            if(!trackBuilt)
+                buildTrack();
+            world->track = &track;
+            if(cfg->scenario == SIM_OBSTACLE){
+                world->walls[world->nWalls++] = (SimWall){ OBSTACLE_AT - OBSTACLE_HALF, -OBSTACLE_HALF, OBSTACLE_AT + OBSTACLE_HALF, -OBSTACLE_HALF };
+                world->walls[world->nWalls++] = (SimWall){ OBSTACLE_AT + OBSTACLE_HALF, -OBSTACLE_HALF, OBSTACLE_AT + OBSTACLE_HALF, OBSTACLE_HALF };
+                world->walls[world->nWalls++] = (SimWall){ OBSTACLE_AT + OBSTACLE_HALF, OBSTACLE_HALF, OBSTACLE_AT - OBSTACLE_HALF, OBSTACLE_HALF };
+                world->walls[world->nWalls++] = (SimWall){ OBSTACLE_AT - OBSTACLE_HALF, OBSTACLE_HALF, OBSTACLE_AT - OBSTACLE_HALF, -OBSTACLE_HALF };
+            }
+            break;
+
+        case SIM_LIGHT :
+            // 4m square room with the lamp near the far corner
+            world->walls[world->nWalls++] = (SimWall){ 0, 0, 4, 0 };
+            world->walls[world->nWalls++] = (SimWall){ 4, 0, 4, 4 };
+            world->walls[world->nWalls++] = (SimWall){ 4, 4, 0, 4 };
+            world->walls[world->nWalls++] = (SimWall){ 0, 4, 0, 0 };
+            world->lightX = 3.0;
+            world->lightY = 3.0;
+            break;
+
+        case SIM_ESCAPE :
+            // 2m square room with a 800mm door in the middle of the top wall,
+            // corners are cut off at 45 degrees like the course boards
+            world->walls[world->nWalls++] = (SimWall){ 0.25, 0, 1.75, 0 };
+            world->walls[world->nWalls++] = (SimWall){ 1.75, 0, 2, 0.25 };
+            world->walls[world->nWalls++] = (SimWall){ 2, 0.25, 2, 1.75 };
+            world->walls[world->nWalls++] = (SimWall){ 2, 1.75, 1.75, 2 };
+            world->walls[world->nWalls++] = (SimWall){ 1.75, 2, 1.4, 2 };
+            world->walls[world->nWalls++] = (SimWall){ 0.6, 2, 0.25, 2 };
+            world->walls[world->nWalls++] = (SimWall){ 0.25, 2, 0, 1.75 };
+            world->walls[world->nWalls++] = (SimWall){ 0, 1.75, 0, 0.25 };
+            world->walls[world->nWalls++] = (SimWall){ 0, 0.25, 0.25, 0 };
+            world->exitY = 2.0 + SIM_ROBOT_RADIUS;
+            break;
+    }
+}
+
+/*******************************************************************************
+ * Function Name        : simWorldPlace
+ *    Returns           : void
+ *    Parameter         : world, robot to place
+ * Description          : Start pose for the scenario, varied a little by the
+ *                        robot's seed along with its motor strengths so
+ *                        repeated runs are not identical. Any motor
+ *                        asymmetry fault goes on top of that.
+ *******************************************************************************/
+void simWorldPlace(SimWorld *world, SimRobot *robot)
+{
+    uint32_t seed = robot->seed;
+
+    robot->gainL = 1.0 + 0.03 * (2 * uniform(seed, 0) - 1);
+    robot->gainR = 1.0 + 0.03 * (2 * uniform(seed, 1) - 1);
+    robot->gainL *= 1.0 - robot->faults.motorAsymmetry / 2;
+    robot->gainR *= 1.0 + robot->faults.motorAsymmetry / 2;
+
+    switch(world->scenario){
+        case SIM_LINE :
+        case SIM_OBSTACLE :
+            // sensors straddling the right hand edge of the first straight
+            robot->x = 0.0;
+            robot->y = -TAPE_HALF_WIDTH + 0.003 * (2 * uniform(seed, 2) - 1);
+            robot->heading = 0.09 * (2 * uniform(seed, 3) - 1);
+            robot->trackIndex = 0;
+            robot->progress = 0;
+            break;
+
+        case SIM_LIGHT :
+            robot->x = 0.7;
+            robot->y = 0.7;
+            robot->heading = 2 * M_PI * uniform(seed, 2);
+            break;
+
+        case SIM_ESCAPE :
+            robot->x = 1.0 + 0.3 * (2 * uniform(seed, 3) - 1);
+            robot->y = 1.0 + 0.3 * (2 * uniform(seed, 4) - 1);
+            robot->heading = 2 * M_PI * uniform(seed, 2);
+            break;
+    }
+}
+
+/*******************************************************************************
+ * Function Name        : simWorldPlaceNth
+ *    Returns           : 0, or -1 if the scenario cannot hold that many
+ *    Parameter         : world, robot to place, its number, size of the crowd
+ * Description          : Start pose for one of a crowd sharing the world.
+ *                        Line robots are spaced evenly round the course, each
+ *                        as far off the tape as simWorldPlace would put it on
+ *                        the first straight, and count their laps from there.
+ *                        In a room they stand on a grid over crowdArea. A
+ *                        crowd of one starts where simWorldPlace puts it.
+ *******************************************************************************/
+int simWorldPlaceNth(SimWorld *world, SimRobot *robot, int nth, int of)
+{
+    const struct SimTrack *t = world->track;
+    double along, h, x, y, spacing;
+    int k, next, side;
+
+    if(of > simWorldCapacity(world))
+        return -1;
+    simWorldPlace(world, robot);
+    if(of <= 1)
+        return 0;
+
+    switch(world->scenario){
+        case SIM_LINE :
+        case SIM_OBSTACLE :
+            along = nth * t->length / of;
+            if(world->scenario == SIM_OBSTACLE && fabs(along - OBSTACLE_AT) < OBSTACLE_HALF + SIM_ROBOT_RADIUS)
+                along = OBSTACLE_AT + OBSTACLE_HALF + SIM_ROBOT_RADIUS;
+            k = (int)(along / (t->length / t->n)) % t->n;
+            next = (k + 1) % t->n;
+            h = atan2(t->py[next] - t->py[k], t->px[next] - t->px[k]);
+            // turn the offset from the start of the first straight round to here
+            x = robot->x;
+            y = robot->y;
+            robot->x = t->px[k] + cos(h) * x - sin(h) * y;
+            robot->y = t->py[k] + sin(h) * x + cos(h) * y;
+            robot->heading += h;
+            robot->trackIndex = k;
+            break;
+
+        default :
+            side = (int)ceil(sqrt(of));
+            spacing = fmin(crowdArea[world->scenario].span / (side - 1), CROWD_SPREAD);
+            robot->x = crowdArea[world->scenario].x + (nth % side - (side - 1) / 2.0) * spacing;
+            robot->y = crowdArea[world->scenario].y + (nth / side - (side - 1) / 2.0) * spacing;
+            break;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+ * Function Name        : simWorldCapacity
+ *    Returns           : most robots the scenario can start at once
+ *    Parameter         : world
+ * Description          : Robots are started at least SIM_CROWD_SPACING apart
+ *******************************************************************************/
+int simWorldCapacity(const SimWorld *world)
+{
+    int side;
+
+    if(world->track)
+        return (int)(world->track->length / SIM_CROWD_SPACING);
+    side = 1 + (int)(crowdArea[world->scenario].span / SIM_CROWD_SPACING + 1e-9);
+    return side * side;
+}
+
+/*******************************************************************************
+ * Function Name        : simWorldTick
+ *    Returns           : void
+ *    Parameter         : world, robot synced to the end of the tick
+ * Description          : Tracks how far round the course the robot has got.
+ *                        Only nearby course points are searched so cutting
+ *                        across the course does not count.
+ *******************************************************************************/
+void simWorldTick(SimWorld *world, SimRobot *robot)
+{
+    const struct SimTrack *t = world->track;
+    double best = 1e9, dx, dy, d;
+    int i, k, bestK = 0;
+
+    if(!t)
+        return;
+
+    for(k = -PROGRESS_WINDOW; k <= PROGRESS_WINDOW; k++){
+        i = (robot->trackIndex + k + t->n) % t->n;
+        dx = t->px[i] - robot->x;
+        dy = t->py[i] - robot->y;
+        d = dx * dx + dy * dy;
+        if(d < best){
+            best = d;
+            bestK = k;
+        }
+    }
+
+    robot->trackIndex = (robot->trackIndex + bestK + t->n) % t->n;
+    robot->progress += bestK * (t->length / t->n);
+}
+
+/*******************************************************************************
+ * Function Name        : simWorldDone
+ *    Returns           : 1 once the robot has completed the scenario
+ *    Parameter         : world, robot
+ *******************************************************************************/
+int simWorldDone(const SimWorld *world, const SimRobot *robot)
+{
+    double dx, dy;
+
+    switch(world->scenario){
+        case SIM_LINE :
+        case SIM_OBSTACLE :
+            return robot->progress >= world->laps * world->track->length;
+
+        case SIM_LIGHT :
+            dx = world->lightX - robot->x;
+            dy = world->lightY - robot->y;
+            return dx * dx + dy * dy < LIGHT_REACHED * LIGHT_REACHED;
+
+        case SIM_ESCAPE :
+            return robot->y > world->exitY;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+ * Function Name        : simWorldOnTape
+ *    Returns           : 1 if there is tape under the point
+ *    Parameter         : world, point in m
+ *******************************************************************************/
+int simWorldOnTape(const SimWorld *world, double x, double y)
+{
+    const struct SimTrack *t = world->track;
+    int cx, cy;
+
+    if(!t)
+        return 0;
+    cx = (int)floor((x * 1000 - t->originX) / RASTER_MM);
+    cy = (int)floor((y * 1000 - t->originY) / RASTER_MM);
+    if(cx < 0 || cy < 0 || cx >= t->width || cy >= t->height)
+        return 0;
+    return t->bitmap[(size_t)cy * t->width + cx];
+}
+
+/*******************************************************************************
+ * Function Name        : simWorldLight
+ *    Returns           : ADC counts above ambient from the lamp
+ *    Parameter         : world, sensor position m, direction it faces rad
+ *******************************************************************************/
+double simWorldLight(const SimWorld *world, double x, double y, double bearing)
+{
+    double dx, dy, d, off, cone;
+
+    if(world->scenario != SIM_LIGHT)
+        return 0;
+
+    dx = world->lightX - x;
+    dy = world->lightY - y;
+    d = sqrt(dx * dx + dy * dy);
+    off = remainder(atan2(dy, dx) - bearing, 2 * M_PI);
+    if(fabs(off) >= M_PI / 2)
+        return 0;
+    if(world->crowd && shaded(world->crowd, x, y, world->lightX, world->lightY))
+        return 0;
+    cone = pow(cos(off), LIGHT_CONE_POW);
+    return LIGHT_PEAK * cone / (1 + (d / LIGHT_FALLOFF) * (d / LIGHT_FALLOFF));
+}
+
+/*******************************************************************************
+ * Track building
+ *******************************************************************************/
+
+// appends points every PROGRESS_STEP along the course, in mm
+static void addPoint(double *px, double *py, int *n, int max, double x, double y)
+{
+    if(*n < max){
+        px[*n] = x;
+        py[*n] = y;
+        (*n)++;
+    }
+}
+
+static void buildTrack(void)
+{
+    double x = 0, y = 0, h = 0, len = 0, step = PROGRESS_STEP * 1000;
+    double minX = 0, maxX = 0, minY = 0, maxY = 0, cx, cy, a, sweep;
+    double *vx, *vy;
+    int nv = 0, maxv = 100000, i, k, pieces;
+
+    // walk the pieces into a fine polyline of the tape centre
+    vx = malloc(maxv * sizeof(double));
+    vy = malloc(maxv * sizeof(double));
+    addPoint(vx, vy, &nv, maxv, x, y);
+
+    pieces = (int)(sizeof(course) / sizeof(course[0]));
+    for(i = 0; i < pieces; i++){
+        switch(course[i].type){
+            case 'S' :
+                for(k = 1; k * step <= course[i].length; k++)
+                    addPoint(vx, vy, &nv, maxv, x + cos(h) * k * step, y + sin(h) * k * step);
+                x += cos(h) * course[i].length;
+                y += sin(h) * course[i].length;
+                if(vx[nv - 1] != x || vy[nv - 1] != y)
+                    addPoint(vx, vy, &nv, maxv, x, y);
+                len += course[i].length;
+                break;
+
+            case 'A' :
+                sweep = course[i].angle * M_PI / 180;
+                // centre of the arc is to the left for a left turn
+                a = sweep > 0 ? h + M_PI / 2 : h - M_PI / 2;
+                cx = x + cos(a) * course[i].length;
+                cy = y + sin(a) * course[i].length;
+                a += M_PI;
+                for(k = 1; k <= (int)ceil(fabs(sweep) * course[i].length / step); k++){
+                    double t = a + sweep * k / ceil(fabs(sweep) * course[i].length / step);
+                    addPoint(vx, vy, &nv, maxv, cx + cos(t) * course[i].length, cy + sin(t) * course[i].length);
+                }
+                x = vx[nv - 1];
+                y = vy[nv - 1];
+                h += sweep;
+                len += fabs(sweep) * course[i].length;
+                break;
+
+            case 'C' :
+                h += course[i].angle * M_PI / 180;
+                break;
+        }
+    }
+
+    for(i = 0; i < nv; i++){
+        minX = fmin(minX, vx[i]);
+        maxX = fmax(maxX, vx[i]);
+        minY = fmin(minY, vy[i]);
+        maxY = fmax(maxY, vy[i]);
+    }
+
+    track.length = len / 1000;
+    track.originX = minX - 100;
+    track.originY = minY - 100;
+    track.width = (int)((maxX - minX + 200) / RASTER_MM) + 1;
+    track.height = (int)((maxY - minY + 200) / RASTER_MM) + 1;
+    track.bitmap = calloc((size_t)track.width * track.height, 1);
+
+    for(i = 1; i < nv; i++)
+        drawTapeSegment(vx[i - 1], vy[i - 1], vx[i], vy[i]);
+
+    // resample evenly for progress, in m
+    track.n = (int)(track.length / PROGRESS_STEP);
+    track.px = malloc(track.n * sizeof(double));
+    track.py = malloc(track.n * sizeof(double));
+    {
+        double want = 0, walked = 0, seg;
+        int j = 1;
+
+        for(i = 0; i < track.n; i++, want += PROGRESS_STEP * 1000){
+            while(j < nv - 1 && walked + hypot(vx[j] - vx[j - 1], vy[j] - vy[j - 1]) < want){
+                walked += hypot(vx[j] - vx[j - 1], vy[j] - vy[j - 1]);
+                j++;
+            }
+            seg = hypot(vx[j] - vx[j - 1], vy[j] - vy[j - 1]);
+            a = seg > 0 ? (want - walked) / seg : 0;
+            track.px[i] = (vx[j - 1] + (vx[j] - vx[j - 1]) * a) / 1000;
+            track.py[i] = (vy[j - 1] + (vy[j] - vy[j - 1]) * a) / 1000;
+        }
+    }
+
+    free(vx);
+    free(vy);
+    trackBuilt = 1;
+}
+
+static void drawTapeSegment(double x1, double y1, double x2, double y2)
+{
+    double hw = TAPE_HALF_WIDTH * 1000, dx = x2 - x1, dy = y2 - y1;
+    double l2 = dx * dx + dy * dy, px, py, t, ex, ey;
+    int cx, cy, x0, xEnd, y0, yEnd;
+
+    x0 = (int)floor((fmin(x1, x2) - hw - track.originX) / RASTER_MM);
+    xEnd = (int)ceil((fmax(x1, x2) + hw - track.originX) / RASTER_MM);
+    y0 = (int)floor((fmin(y1, y2) - hw - track.originY) / RASTER_MM);
+    yEnd = (int)ceil((fmax(y1, y2) + hw - track.originY) / RASTER_MM);
+
+    for(cy = y0; cy <= yEnd; cy++){
+        for(cx = x0; cx <= xEnd; cx++){
+            if(cx < 0 || cy < 0 || cx >= track.width || cy >= track.height)
+                continue;
+            px = track.originX + (cx + 0.5) * RASTER_MM;
+            py = track.originY + (cy + 0.5) * RASTER_MM;
+            t = l2 > 0 ? ((px - x1) * dx + (py - y1) * dy) / l2 : 0;
+            t = t < 0 ? 0 : (t > 1 ? 1 : t);
+            ex = px - (x1 + t * dx);
+            ey = py - (y1 + t * dy);
+            if(ex * ex + ey * ey <= hw * hw)
+                track.bitmap[(size_t)cy * track.width + cx] = 1;
+        }
+    }
+}
+
+/*******************************************************************************
+ * Function Name        : shaded
+ *    Returns           : 1 if another robot is in the way
+ *    Parameter         : crowd, sensor position, what it is looking at, m
+ * Description          : Looks up the bodies round points a cell apart along
+ *                        the line of sight, which finds every body the line
+ *                        passes through. The body the sensor is inside is
+ *                        its own robot.
+ *******************************************************************************/
+static int shaded(const SimCrowd *crowd, double x, double y, double toX, double toY)
+{
+    const SimBody *near[crowd->max];
+    double dx = toX - x, dy = toY - y, len = sqrt(dx * dx + dy * dy);
+    double along, t, bx, by, ex, ey, r2 = SIM_ROBOT_RADIUS * SIM_ROBOT_RADIUS;
+    int i, n;
+
+    if(len < 1e-9)
+        return 0;
+
+    for(along = 0; along < len + SIM_CROWD_CELL; along += SIM_CROWD_CELL){
+        t = fmin(along / len, 1);
+        n = simCrowdNear(crowd, x + dx * t, y + dy * t, near, crowd->max);
+        for(i = 0; i < n; i++){
+            bx = near[i]->x - x;
+            by = near[i]->y - y;
+            if(bx * bx + by * by < r2)
+                continue;
+            t = (bx * dx + by * dy) / (len * len);
+            t = t < 0 ? 0 : (t > 1 ? 1 : t);
+            ex = bx - dx * t;
+            ey = by - dy * t;
+            if(ex * ex + ey * ey < r2)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+// repeatable uniform [0, 1) from a seed and a stream number
+static double uniform(uint32_t seed, int which)
+{
+    uint32_t h = seed * 0x9E3779B1u ^ (uint32_t)(which + 1) * 0x85EBCA77u;
+
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h / 4294967296.0;
+}
@@ -0,0 +1,152 @@
+/*******************************************************************************
+ * Program Name         : telemdec.c
+ * Project              : Marco Robot Coursework - host tools
+ * Created By           : Connor Parker
+ * Date Created         : 19/10/26
+ * Description          : Decodes the binary telemetry stream written by
+ *                        Telemetry.c into CSV, one line per record.
+ *
+ *                        Usage: telemdec [-f timestamp_hz] [file]
+ *
+ *                        Reads stdin if no file is given, e.g.
+ *                          nios2-terminal --no-quit-on-ctrl-d | telemdec
+ *                        Records with a bad checksum are skipped and the
+ *                        stream resynchronised on the next sync byte.
+ *                        A summary of lost and corrupt records is written
+ *                        to stderr at the end.
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* Must match Telemetry.h */
+#define TELEMETRY_SYNC         0xA5
+#define TELEMETRY_RECORD_SIZE  16
+#define TELEMETRY_SENSOR_SHIFT 11
+
+// Header bits, all active low
+#define LEFT_FLOOR_SENSOR  0x4000
+#define RIGHT_FLOOR_SENSOR 0x2000
+#define LEFT_FRONT_BUMPER  0x8000
+#define RIGHT_FRONT_BUMPER 0x800
+#define LEFT_EYE_SWITCH    0x20000
+#define RIGHT_EYE_SWITCH   0x10000
+
+/* default alt_timestamp() rate, the 50MHz system clock */
+#define DEFAULT_TIMESTAMP_HZ 50000000.0
+
+static uint32_t get32(const uint8_t *p);
+static void printRecord(const uint8_t *record, uint64_t tick, double hz);
+static void printSensor(uint32_t header, uint32_t sent, uint32_t bit);
+
+int main(int argc, char *argv[])
+{
+    FILE *in = stdin;
+    double hz = DEFAULT_TIMESTAMP_HZ;
+    uint8_t window[TELEMETRY_RECORD_SIZE];
+    size_t fill = 0;
+    int c, i, haveLast = 0;
+    uint8_t checksum, lastSeq = 0;
+    uint32_t lastTick = 0;
+    uint64_t tick = 0;
+    unsigned long records = 0, lost = 0, badBytes = 0;
+
+    for(i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "-f") && (i + 1 < argc))
+            hz = atof(argv[++i]);
+        else if(in == stdin){
+            in = fopen(argv[i], "rb");
+            if(!in){
+                perror(argv[i]);
+                return 1;
+            }
+        }
+        else{
+            fprintf(stderr, "usage: telemdec [-f timestamp_hz] [file]\n");
+            return 1;
+        }
+    }
+
+    printf("seq,tick,time_us,header,left_line,right_line,left_bumper,right_bumper,"
+           "left_eye,right_eye,motor,stepper,adc,state\n");
+
+    while((c = getc(in)) != EOF){
+        window[fill++] = (uint8_t)c;
+
+        // wait for a full record starting on a sync byte
+        if(window[0] != TELEMETRY_SYNC){
+            fill = 0;
+            badBytes++;
+            continue;
+        }
+        if(fill < TELEMETRY_RECORD_SIZE)
+            continue;
+
+        checksum = 0;
+        for(i = 1; i < TELEMETRY_RECORD_SIZE - 1; i++)
+            checksum += window[i];
+
+        if(checksum != window[TELEMETRY_RECORD_SIZE - 1]){
+            // not a real record, slide on one byte and look for the next sync
+            badBytes++;
+            memmove(window, window + 1, --fill);
+            while(fill && window[0] != TELEMETRY_SYNC){
+                memmove(window, window + 1, --fill);
+                badBytes++;
+            }
+            continue;
+        }
+
+        // unwrap the 32 bit tick and count sequence gaps
+        if(haveLast){
+            tick += (uint32_t)(get32(window + 2) - lastTick);
+            lost += (uint8_t)(window[1] - lastSeq - 1);
+        }
+        haveLast = 1;
+        lastTick = get32(window + 2);
+        lastSeq = window[1];
+        records++;
+
+        printRecord(window, tick, hz);
+        fill = 0;
+    }
+
+    fprintf(stderr, "telemdec: %lu records, %lu lost, %lu bad bytes\n", records, lost, badBytes);
+
+    if(in != stdin)
+        fclose(in);
+    return 0;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// a sensor the module does not send is an empty column, not a 0 or 1
+static void printRecord(const uint8_t *record, uint64_t tick, double hz)
+{
+    uint32_t header = get32(record + 6) & 0x00FFFFFF;
+    uint32_t sent = (uint32_t)record[9] << TELEMETRY_SENSOR_SHIFT;
+    unsigned adc = (unsigned)record[10] | ((unsigned)record[11] << 8);
+
+    printf("%u,%llu,%.1f,0x%08X", record[1], (unsigned long long)tick, (double)tick * 1e6 / hz, header);
+    printSensor(header, sent, LEFT_FLOOR_SENSOR);
+    printSensor(header, sent, RIGHT_FLOOR_SENSOR);
+    printSensor(header, sent, LEFT_FRONT_BUMPER);
+    printSensor(header, sent, RIGHT_FRONT_BUMPER);
+    printSensor(header, sent, LEFT_EYE_SWITCH);
+    printSensor(header, sent, RIGHT_EYE_SWITCH);
+    printf(",0x%X,%u,%u,%u\n", record[12], record[13], adc, record[14]);
+}
+
+// sensors are active low so a clear bit means seen / pressed
+static void printSensor(uint32_t header, uint32_t sent, uint32_t bit)
+{
+    if(sent & bit)
+        printf(",%d", !(header & bit));
+    else
+        printf(",");
+}